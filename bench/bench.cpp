@@ -0,0 +1,397 @@
+/**
+ * \author Lucas Kramer
+ * \file  bench.cpp
+ * \brief Benchmarks for loading configurations and looking up values.  
+ * \details Usage: bench [--quick]<br>
+ * Synthetic configurations are generated in a temporary directory, varying
+ * the number of lines, the depth of use includes, and the fraction of strings
+ * with $ references.  Results are written to standard output as JSON: load
+ * times in milliseconds, eagerly and lazily, rebuild times, the p50 and p99
+ * latency of each getter in nanoseconds, lookup throughput with increasing
+ * numbers of threads, the time to visit every value in order and to dump them
+ * as text and binary, and the time to attach to a configuration in shared
+ * memory and read its values there.  
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "configuration.h"
+#include "loader.h"
+
+typedef chrono::steady_clock benchClock;
+
+static double elapsedNs(benchClock::time_point start, benchClock::time_point end) {
+  return chrono::duration<double, nano>(end - start).count();
+}
+
+/** Keeps the compiler from discarding the values that are read.  */
+static volatile size_t sink;
+
+/**
+ * \brief The settings of a generated configuration
+ */
+struct configShape {
+  unsigned lines;
+  unsigned depth;
+  double varDensity;
+};
+
+/**
+ * \brief The names of the values in a generated configuration, by type
+ */
+struct generatedNames {
+  vector<string> ints, floats, bools, chars, strings, expanded;
+};
+
+/**
+ * \brief Writes a configuration as a chain of files, each using the next
+ * \return The root file
+ */
+static string generateConfig(const string &dir, const configShape &shape, generatedNames &names) {
+  mt19937 rng(shape.lines * 31 + shape.depth * 7 + (unsigned)(shape.varDensity * 100));
+  uniform_real_distribution<double> chance(0, 1);
+  unsigned files = shape.depth + 1;
+  ostringstream prefix;
+  prefix << dir << "/gen_" << shape.lines << "_" << shape.depth << "_" << (unsigned)(shape.varDensity * 100);
+
+  for (unsigned f = 0; f < files; f++) {
+    ofstream out(prefix.str() + "_" + to_string(f) + ".cfg");
+    if (f + 1 < files) {
+      string next = prefix.str() + "_" + to_string(f + 1) + ".cfg";
+      out << "use \"" << next.substr(next.rfind('/') + 1) << "\"" << endl;
+    }
+    for (unsigned i = f; i < shape.lines; i += files) {
+      string name = "f" + to_string(f) + "_v" + to_string(i);
+      switch (i % 5) {
+      case 0:
+        out << "int " << name << " = " << rng() % 100000 << endl;
+        names.ints.push_back(name);
+        break;
+      case 1:
+        out << "float " << name << " = " << (rng() % 100000) / 100.0 << endl;
+        names.floats.push_back(name);
+        break;
+      case 2:
+        out << "bool " << name << " = " << (rng() % 2? "true" : "false") << endl;
+        names.bools.push_back(name);
+        break;
+      case 3:
+        out << "char " << name << " = '" << (char)('a' + rng() % 26) << "'" << endl;
+        names.chars.push_back(name);
+        break;
+      case 4:
+        if (!names.strings.empty() && chance(rng) < shape.varDensity) {
+          const string &ref = names.strings[rng() % names.strings.size()];
+          out << "string " << name << " = \"value of $" << ref << " here\"" << endl;
+          names.expanded.push_back(name);
+        }
+        else {
+          out << "string " << name << " = \"plain string value " << i << "\"" << endl;
+          names.strings.push_back(name);
+        }
+        break;
+      }
+    }
+  }
+  return prefix.str() + "_0.cfg";
+}
+
+/**
+ * \brief Runs a function repeatedly, for at least a few runs and a minimum time
+ * \return The median time of a run, in milliseconds
+ */
+template <typename F>
+static double medianMs(F f, unsigned minRuns, double minMs) {
+  vector<double> times;
+  double total = 0;
+  while (times.size() < minRuns || total < minMs) {
+    benchClock::time_point start = benchClock::now();
+    f();
+    double ms = elapsedNs(start, benchClock::now()) / 1e6;
+    times.push_back(ms);
+    total += ms;
+  }
+  sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+static void benchLoad(ostream &json, const string &dir, const configShape &shape, bool quick) {
+  generatedNames names;
+  string root = generateConfig(dir, shape, names);
+  unsigned runs = quick? 3 : 10;
+
+  double loadMs = medianMs([&] {
+    ConfigTable table;
+    vector<configError> errors;
+    if (!loadConfig(root, table, errors)) {
+      cerr << errors[0].message() << endl;
+      exit(1);
+    }
+  }, runs, quick? 50 : 500);
+
+  double lazyLoadMs = medianMs([&] {
+    ConfigTable table;
+    parseCache cache;
+    vector<configError> errors;
+    if (!loadConfig(root, cache, table, errors, true)) {
+      cerr << errors[0].message() << endl;
+      exit(1);
+    }
+  }, runs, quick? 50 : 500);
+
+  // With no files changed, a refresh only rebuilds the snapshot
+  Configuration::initConfig(root);
+  Configuration::get();
+  double rebuildMs = medianMs([&] {
+    Configuration::initConfig(root);
+    Configuration::tryRefresh();
+  }, runs, quick? 50 : 500);
+
+  json << "    {\"lines\": " << shape.lines << ", \"depth\": " << shape.depth <<
+    ", \"var_density\": " << shape.varDensity << ", \"load_ms\": " << loadMs << ", \"lazy_load_ms\": " << lazyLoadMs <<
+    ", \"rebuild_ms\": " << rebuildMs << "}";
+}
+
+/**
+ * \brief Measures the latency of a getter over random values
+ * \details Calls are timed in small batches, since a single call is close to
+ * the resolution of the clock.  
+ */
+template <typename F>
+static void benchGetter(ostream &json, const char *getter, size_t count, F f, bool quick, bool last) {
+  const unsigned batch = 16;
+  unsigned batches = quick? 2000 : 20000;
+  mt19937 rng(batches);
+  vector<unsigned> order(batch * 64);
+  for (unsigned &i : order)
+    i = rng() % count;
+
+  vector<double> samples;
+  samples.reserve(batches);
+  size_t sum = 0;
+  for (unsigned b = 0; b < batches; b++) {
+    const unsigned *indices = &order[(b % 64) * batch];
+    benchClock::time_point start = benchClock::now();
+    for (unsigned i = 0; i < batch; i++)
+      sum += f(indices[i]);
+    samples.push_back(elapsedNs(start, benchClock::now()) / batch);
+  }
+  sink = sum;
+  sort(samples.begin(), samples.end());
+
+  json << "    {\"getter\": \"" << getter << "\", \"p50_ns\": " << samples[samples.size() / 2] <<
+    ", \"p99_ns\": " << samples[samples.size() * 99 / 100] << "}" << (last? "" : ",") << endl;
+}
+
+static void benchLookups(ostream &json, const string &dir, bool quick) {
+  generatedNames names;
+  string root = generateConfig(dir, configShape{quick? 10000u : 100000u, 4, 0.2}, names);
+  Configuration::initConfig(root);
+  Configuration::refresh();
+  Configuration *c = Configuration::get();
+
+  vector<Configuration::Handle<int>> handles;
+  for (const string &name : names.ints)
+    handles.push_back(c->lookup<int>(name));
+
+  json << "  \"lookup\": [" << endl;
+  benchGetter(json, "getIntConfig", names.ints.size(), [&](unsigned i) {
+    return (size_t)c->getIntConfig(names.ints[i]);
+  }, quick, false);
+  benchGetter(json, "getFloatConfig", names.floats.size(), [&](unsigned i) {
+    return (size_t)c->getFloatConfig(names.floats[i]);
+  }, quick, false);
+  benchGetter(json, "getBoolConfig", names.bools.size(), [&](unsigned i) {
+    return (size_t)c->getBoolConfig(names.bools[i]);
+  }, quick, false);
+  benchGetter(json, "getCharConfig", names.chars.size(), [&](unsigned i) {
+    return (size_t)c->getCharConfig(names.chars[i]);
+  }, quick, false);
+  benchGetter(json, "getStringConfig", names.strings.size(), [&](unsigned i) {
+    return c->getStringConfig(names.strings[i]).size();
+  }, quick, false);
+  benchGetter(json, "getStringConfig_expanded", names.expanded.size(), [&](unsigned i) {
+    return c->getStringConfig(names.expanded[i]).size();
+  }, quick, false);
+  benchGetter(json, "getStringView", names.strings.size(), [&](unsigned i) {
+    return c->getStringView(names.strings[i]).size();
+  }, quick, false);
+  benchGetter(json, "tryGet_int_missing", names.strings.size(), [&](unsigned i) {
+    return (size_t)c->tryGet<int>(names.strings[i]).has_value();
+  }, quick, false);
+  // A hot set of values, read from the table and then through the per-thread cache
+  benchGetter(json, "getIntConfig_hot", min<size_t>(names.ints.size(), 32), [&](unsigned i) {
+    return (size_t)c->getIntConfig(names.ints[i]);
+  }, quick, false);
+  Configuration::setReadCache(true);
+  benchGetter(json, "getIntConfig_cached", min<size_t>(names.ints.size(), 32), [&](unsigned i) {
+    return (size_t)c->getIntConfig(names.ints[i]);
+  }, quick, false);
+  Configuration::setReadCache(false);
+  benchGetter(json, "handle_int", handles.size(), [&](unsigned i) {
+    return (size_t)handles[i].get();
+  }, quick, false);
+  // Fills 8 values per call
+  benchGetter(json, "fill_8_ints", names.ints.size() - 8, [&](unsigned i) {
+    int v[8];
+    const vector<string> &n = names.ints;
+    c->fill({configBind(n[i].c_str(), v[0]), configBind(n[i + 1].c_str(), v[1]),
+             configBind(n[i + 2].c_str(), v[2]), configBind(n[i + 3].c_str(), v[3]),
+             configBind(n[i + 4].c_str(), v[4]), configBind(n[i + 5].c_str(), v[5]),
+             configBind(n[i + 6].c_str(), v[6]), configBind(n[i + 7].c_str(), v[7])});
+    return (size_t)v[0] + v[7];
+  }, quick, false);
+  // Fills a struct of 8 values per call, resolved once
+  struct eightInts { int a, b, c, d, e, f, g, h; };
+  int eightInts::*const members[8] = {&eightInts::a, &eightInts::b, &eightInts::c, &eightInts::d,
+                                      &eightInts::e, &eightInts::f, &eightInts::g, &eightInts::h};
+  vector<Configuration::Binder<eightInts>> binders(64);
+  for (size_t b = 0; b < binders.size(); b++) {
+    for (unsigned j = 0; j < 8; j++)
+      binders[b].bind(names.ints[(b * 8 + j) % names.ints.size()], members[j]);
+  }
+  benchGetter(json, "binder_8_ints", binders.size(), [&](unsigned i) {
+    eightInts s;
+    binders[i].fill(s);
+    return (size_t)s.a + s.h;
+  }, quick, true);
+  json << "  ]," << endl;
+
+  // Throughput of getIntConfig with increasing numbers of threads
+  json << "  \"threads\": [" << endl;
+  unsigned maxThreads = max(thread::hardware_concurrency(), 1u);
+  unsigned reads = quick? 200000 : 2000000;
+  for (unsigned threads = 1; ; threads *= 2) {
+    threads = min(threads, maxThreads);
+    atomic<bool> go(false);
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+      workers.emplace_back([&, t] {
+        mt19937 rng(t);
+        vector<unsigned> order(4096);
+        for (unsigned &i : order)
+          i = rng() % names.ints.size();
+        while (!go.load()) {}
+        size_t sum = 0;
+        for (unsigned i = 0; i < reads; i++)
+          sum += Configuration::get()->getIntConfig(names.ints[order[i % order.size()]]);
+        sink = sum;
+      });
+    }
+    benchClock::time_point start = benchClock::now();
+    go.store(true);
+    for (thread &w : workers)
+      w.join();
+    double seconds = elapsedNs(start, benchClock::now()) / 1e9;
+
+    json << "    {\"threads\": " << threads << ", \"reads_per_sec\": " << threads * (double)reads / seconds <<
+      "}" << (threads == maxThreads? "" : ",") << endl;
+    if (threads == maxThreads)
+      break;
+  }
+  json << "  ]," << endl;
+
+  // Visiting every value in order, the first time including the sort, and
+  // writing them all out
+  auto timeMs = [](auto f) {
+    benchClock::time_point start = benchClock::now();
+    f();
+    return elapsedNs(start, benchClock::now()) / 1e6;
+  };
+  size_t visited = 0;
+  auto visit = [&visited](string_view name, const configValue &) { visited += name.size(); };
+  double firstMs = timeMs([&] { c->forEach(visit); });
+  double visitMs = timeMs([&] { c->forEach(visit); });
+  sink = visited;
+  ostringstream text, binary;
+  double textMs = timeMs([&] { c->dumpConfig(text); });
+  double binaryMs = timeMs([&] { c->dumpConfig(binary, CONFIG_DUMP_BINARY); });
+  json << "  \"dump\": {\"first_forEach_ms\": " << firstMs << ", \"forEach_ms\": " << visitMs <<
+    ", \"text_ms\": " << textMs << ", \"text_bytes\": " << text.str().size() << ", \"binary_ms\": " <<
+    binaryMs << ", \"binary_bytes\": " << binary.str().size() << "}," << endl;
+
+  // Attaching to the configuration in shared memory, published by another
+  // process, and reading every int from it the first time and again
+  string sharedName = "/config_bench_" + to_string(getpid());
+  pid_t publisher = fork();
+  if (publisher == 0)
+    _exit(Configuration::tryPublishShared(sharedName).empty()? 0 : 1);
+  int status = 1;
+  if (publisher < 0 || waitpid(publisher, &status, 0) != publisher || status != 0) {
+    cerr << "Could not publish " << sharedName << endl;
+    exit(1);
+  }
+  double attachMs = timeMs([&] {
+    Configuration::attachShared(sharedName);
+    Configuration::refresh();
+  });
+  Configuration *attached = Configuration::get();
+  size_t sum = 0;
+  double firstReadMs = timeMs([&] {
+    for (const string &name : names.ints)
+      sum += attached->getIntConfig(name);
+  });
+  double readMs = timeMs([&] {
+    for (const string &name : names.ints)
+      sum += attached->getIntConfig(name);
+  });
+  sink = sum;
+  shm_unlink((sharedName + ".1").c_str());
+  shm_unlink(sharedName.c_str());
+  json << "  \"shared\": {\"values\": " << names.ints.size() << ", \"attach_ms\": " << attachMs <<
+    ", \"first_read_ms\": " << firstReadMs << ", \"read_ms\": " << readMs << "}" << endl;
+}
+
+int main(int argc, char *argv[]) {
+  bool quick = argc > 1 && string(argv[1]) == "--quick";
+
+  const char *tmp = getenv("TMPDIR");
+  string dirTemplate = string(tmp != NULL? tmp : "/tmp") + "/config_bench_XXXXXX";
+  vector<char> dirName(dirTemplate.begin(), dirTemplate.end());
+  dirName.push_back('\0');
+  if (mkdtemp(dirName.data()) == NULL) {
+    cerr << "Could not create a directory for the generated configurations" << endl;
+    return 1;
+  }
+  string dir(dirName.data());
+
+  vector<configShape> shapes;
+  for (unsigned lines : {1000u, 10000u, 100000u})
+    shapes.push_back(configShape{lines, 0, 0.1});
+  for (unsigned depth : {4u, 16u})
+    shapes.push_back(configShape{10000, depth, 0.1});
+  for (double density : {0.0, 0.5, 1.0})
+    shapes.push_back(configShape{10000, 0, density});
+  if (quick)
+    shapes.erase(shapes.begin() + 2);
+
+  ostringstream json;
+  json << "{" << endl << "  \"load\": [" << endl;
+  for (size_t i = 0; i < shapes.size(); i++) {
+    benchLoad(json, dir, shapes[i], quick);
+    json << (i + 1 < shapes.size()? "," : "") << endl;
+  }
+  json << "  ]," << endl;
+  benchLookups(json, dir, quick);
+  json << "}" << endl;
+  cout << json.str();
+
+  string cleanup = "rm -rf '" + dir + "'";
+  if (system(cleanup.c_str()) != 0)
+    cerr << "Could not remove " << dir << endl;
+  return 0;
+}
@@ -0,0 +1,298 @@
+/**
+ * \author Lucas Kramer
+ * \file  stress.cpp
+ * \brief Stress tests for loading configurations at scale.  
+ * \details Usage: stress [--quick]<br>
+ * Each scenario generates configurations of doubling sizes in a temporary
+ * directory: many keys in one file, very long lines and arrays, long quoted
+ * values full of # characters and of quotes, lines of quotes that never
+ * close, deep and wide trees of includes, and layers sharing a common base.  
+ * Each size is loaded in a child process, which reports the load time, and
+ * the peak resident memory of the child is taken from the kernel; the fastest
+ * of three loads is kept, as a single one may be slowed by other processes.  
+ * Results are written to standard output as JSON, with the growth exponent of
+ * time and memory between the two largest sizes; an exponent above 1.5 means
+ * the cost grows worse than linearly, and makes the program exit with a
+ * failure, as does a load that takes longer than the budget of its scenario.  
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "configuration.h"
+
+/** Growth exponents above this are reported as performance cliffs.  */
+static const double MAX_EXPONENT = 1.5;
+
+/** Times and sizes below these are too noisy to fit exponents to.  */
+static const double MIN_FIT_MS = 5;
+static const long MIN_FIT_KB = 4096;
+
+/** How many times each size is loaded.  */
+static const unsigned RUNS = 3;
+
+/**
+ * \brief A family of generated configurations, of increasing size
+ */
+struct scenario {
+  const char *name;
+  /** The sizes, in the unit of the scenario.  */
+  vector<unsigned long> sizes;
+  /** Writes a configuration of a size into a directory, returning the root file.  */
+  function<string(const string &dir, unsigned long size)> generate;
+  /** If loading should report errors rather than succeed.  */
+  bool fails = false;
+  /** The longest any size may take to load, or 0 for no limit.  */
+  double budgetMs = 0;
+};
+
+/**
+ * \brief The time and memory of loading one configuration
+ */
+struct measurement {
+  bool ok;
+  double ms;
+  long peakKb;
+};
+
+/**
+ * \brief Loads a configuration in a child process
+ * \param fails If loading should report errors
+ * \param budgetMs If not 0, the child is stopped once it runs well past this
+ */
+static measurement measure(const string &root, bool fails = false, double budgetMs = 0) {
+  measurement result = {false, 0, 0};
+  int fds[2];
+  if (pipe(fds) != 0)
+    return result;
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    if (budgetMs > 0)
+      alarm((unsigned)ceil(budgetMs / 1000) + 1);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Configuration::initConfig(root);
+    vector<configError> errors = Configuration::tryRefresh();
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if (errors.empty() == fails)
+      ms = -1;
+    ssize_t written = write(fds[1], &ms, sizeof(ms));
+    _exit(written == sizeof(ms)? 0 : 1);
+  }
+  close(fds[1]);
+  double ms = -1;
+  bool read_ok = pid > 0 && read(fds[0], &ms, sizeof(ms)) == sizeof(ms);
+  close(fds[0]);
+  int status;
+  struct rusage usage;
+  if (pid > 0 && wait4(pid, &status, 0, &usage) == pid && read_ok && ms >= 0 &&
+      WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+    result.ok = true;
+    result.ms = ms;
+    result.peakKb = usage.ru_maxrss;
+  }
+  return result;
+}
+
+/**
+ * \brief Fits the exponent of the growth of a cost between two sizes
+ * \return The exponent, or 0 if the costs are too small to tell
+ */
+static double exponent(double a, double b, unsigned long sizeA, unsigned long sizeB, double minimum) {
+  if (b < minimum || a <= 0)
+    return 0;
+  return log(b / a) / log((double)sizeB / sizeA);
+}
+
+static string lines(const string &dir, unsigned long size) {
+  string root = dir + "/keys.cfg";
+  ofstream out(root);
+  for (unsigned long i = 0; i < size; i++) {
+    switch (i % 4) {
+    case 0: out << "int K" << i << " = " << i << "\n"; break;
+    case 1: out << "double K" << i << " = " << i << ".5\n"; break;
+    case 2: out << "string K" << i << " = \"value " << i << "\"\n"; break;
+    case 3: out << "bool K" << i << " = true\n"; break;
+    }
+  }
+  return root;
+}
+
+static string longLine(const string &dir, unsigned long size) {
+  string root = dir + "/line.cfg";
+  ofstream out(root);
+  out << "string S = \"" << string(size, 'x') << "\"\n";
+  return root;
+}
+
+static string longHashes(const string &dir, unsigned long size) {
+  // Quoted text full of comment characters; the value ends at the first " #"
+  string root = dir + "/hashes.cfg";
+  ofstream out(root);
+  out << "string S = \"";
+  for (unsigned long i = 0; i < size; i += 4)
+    out << "a # ";
+  out << "\" # " << string(size / 2, '#') << "\n";
+  return root;
+}
+
+static string manyQuotes(const string &dir, unsigned long size) {
+  // Quoted sections separated by spaces, which the scanner must match as a whole
+  string root = dir + "/quotes.cfg";
+  ofstream out(root);
+  out << "string S = \"";
+  for (unsigned long i = 0; i < size; i += 4)
+    out << "a\" \"";
+  out << "\" # comment\n";
+  return root;
+}
+
+static string unclosedQuotes(const string &dir, unsigned long size) {
+  // Quotes that no later quote closes, so no quoted section can span the
+  // space, and the line is a syntax error
+  string root = dir + "/unclosed.cfg";
+  ofstream out(root);
+  out << "string S = " << string(size, '"') << " x\n";
+  return root;
+}
+
+static string longArray(const string &dir, unsigned long size) {
+  string root = dir + "/array.cfg";
+  ofstream out(root);
+  out << "int[] A = [";
+  for (unsigned long i = 0; i < size; i++)
+    out << (i? ", " : "") << i % 1000;
+  out << "]\n";
+  return root;
+}
+
+static string includeChain(const string &dir, unsigned long size) {
+  for (unsigned long i = 0; i < size; i++) {
+    ofstream out(dir + "/chain_" + to_string(i) + ".cfg");
+    if (i + 1 < size)
+      out << "use \"chain_" << i + 1 << ".cfg\"\n";
+    out << "int C" << i << " = " << i << "\n";
+  }
+  return dir + "/chain_0.cfg";
+}
+
+static string includeFan(const string &dir, unsigned long size) {
+  string root = dir + "/fan.cfg";
+  ofstream out(root);
+  for (unsigned long i = 0; i < size; i++) {
+    out << "use \"fan_" << i << ".cfg\"\n";
+    ofstream leaf(dir + "/fan_" + to_string(i) + ".cfg");
+    leaf << "int F" << i << " = " << i << "\n";
+  }
+  return root;
+}
+
+static string includeLayers(const string &dir, unsigned long size) {
+  // Layers in a subdirectory that all include a common base
+  mkdir((dir + "/layers").c_str(), 0700);
+  ofstream base(dir + "/common.cfg");
+  for (unsigned i = 0; i < 1000; i++)
+    base << "int BASE" << i << " = " << i << "\n";
+  string root = dir + "/layered.cfg";
+  ofstream out(root);
+  for (unsigned long i = 0; i < size; i++) {
+    out << "use \"layers/layer_" << i << ".cfg\"\n";
+    ofstream layer(dir + "/layers/layer_" + to_string(i) + ".cfg");
+    layer << "use \"../common.cfg\"\nint L" << i << " = " << i << "\n";
+  }
+  return root;
+}
+
+int main(int argc, char *argv[]) {
+  bool quick = argc > 1 && string(argv[1]) == "--quick";
+  // The sizes double, so the largest two give the exponent
+  auto doubling = [quick](unsigned long first, unsigned count) {
+    vector<unsigned long> sizes;
+    unsigned long size = quick? first / 4 : first;
+    for (unsigned i = 0; i < count; i++, size *= 2)
+      sizes.push_back(size);
+    return sizes;
+  };
+  vector<scenario> scenarios = {
+    {"keys", doubling(250000, 4), lines},
+    {"long_line_bytes", doubling(1 << 20, 4), longLine},
+    {"long_quoted_hashes_bytes", doubling(1 << 20, 4), longHashes},
+    {"many_quotes_bytes", doubling(1 << 18, 4), manyQuotes},
+    {"unclosed_quotes_bytes", doubling(1 << 18, 4), unclosedQuotes, true, 1000},
+    {"long_array_elements", doubling(250000, 4), longArray},
+    {"include_depth", doubling(250, 4), includeChain},
+    {"include_width", doubling(250, 4), includeFan},
+    {"include_shared_base_layers", doubling(32, 4), includeLayers},
+  };
+
+  const char *tmp = getenv("TMPDIR");
+  string dirTemplate = string(tmp != NULL? tmp : "/tmp") + "/config_stress_XXXXXX";
+  vector<char> dirName(dirTemplate.begin(), dirTemplate.end());
+  dirName.push_back('\0');
+  if (mkdtemp(dirName.data()) == NULL) {
+    cerr << "Could not create a directory for the generated configurations" << endl;
+    return 1;
+  }
+  string dir(dirName.data());
+
+  // The memory of a process loading almost nothing, subtracted from the others
+  measurement baseline = measure(lines(dir, 1));
+  bool ok = baseline.ok;
+
+  ostringstream json;
+  json << "{" << endl << "  \"baseline_kb\": " << baseline.peakKb << "," << endl << "  \"scenarios\": [" << endl;
+  for (size_t s = 0; s < scenarios.size(); s++) {
+    const scenario &sc = scenarios[s];
+    vector<measurement> results;
+    json << "    {\"scenario\": \"" << sc.name << "\", \"runs\": [";
+    for (size_t i = 0; i < sc.sizes.size(); i++) {
+      string sub = dir + "/" + sc.name + "_" + to_string(i);
+      if (system(("mkdir -p '" + sub + "'").c_str()) != 0) {
+        cerr << "Could not create " << sub << endl;
+        return 1;
+      }
+      string root = sc.generate(sub, sc.sizes[i]);
+      measurement m = measure(root, sc.fails, sc.budgetMs);
+      for (unsigned run = 1; run < RUNS && m.ok; run++) {
+        measurement next = measure(root, sc.fails, sc.budgetMs);
+        if (!next.ok || next.ms < m.ms)
+          m = next;
+      }
+      results.push_back(m);
+      ok &= m.ok && (sc.budgetMs == 0 || m.ms <= sc.budgetMs);
+      json << (i? ", " : "") << "{\"size\": " << sc.sizes[i] << ", \"ok\": " << (m.ok? "true" : "false") <<
+        ", \"ms\": " << m.ms << ", \"peak_kb\": " << m.peakKb << "}";
+      if (system(("rm -rf '" + sub + "'").c_str()) != 0)
+        cerr << "Could not remove " << sub << endl;
+    }
+
+    size_t last = results.size() - 1;
+    double timeExponent = exponent(results[last - 1].ms, results[last].ms,
+                                   sc.sizes[last - 1], sc.sizes[last], MIN_FIT_MS);
+    double memoryExponent = exponent(results[last - 1].peakKb - baseline.peakKb,
+                                     results[last].peakKb - baseline.peakKb,
+                                     sc.sizes[last - 1], sc.sizes[last], MIN_FIT_KB);
+    bool cliff = timeExponent > MAX_EXPONENT || memoryExponent > MAX_EXPONENT;
+    ok &= !cliff;
+    json << "], \"time_exponent\": " << timeExponent << ", \"memory_exponent\": " << memoryExponent <<
+      ", \"cliff\": " << (cliff? "true" : "false") << "}" << (s + 1 < scenarios.size()? "," : "") << endl;
+  }
+  json << "  ]" << endl << "}" << endl;
+  cout << json.str();
+
+  if (system(("rm -rf '" + dir + "'").c_str()) != 0)
+    cerr << "Could not remove " << dir << endl;
+  return ok? 0 : 1;
+}
@@ -0,0 +1,219 @@
+/**
+ * \author Lucas Kramer
+ * \file  fuzz_config.cpp
+ * \brief Fuzzing target for parsing values and loading configurations.  
+ * \details Built for libFuzzer with make fuzz, or as a standalone driver with
+ * make bin/fuzz_replay.<br>
+ * The input is split at NUL bytes into virtual files named 0, 1, 2 and so
+ * on, which are loaded from file 0 through Configuration::tryLoadStream, with
+ * use lines resolved to the virtual files by number, so includes can form
+ * diamonds and cycles.  The first line of the input
+ * is also parsed as a type name and the second as a value.  The first byte
+ * selects eager or lazy parsing and the chunk size the input is streamed in,
+ * so chunk boundaries fall everywhere.  Loaded configurations are dumped as
+ * text.  <br>
+ * Usage: fuzz_replay [--random \<runs\> [\<seed\>]] [\<file\>...]<br>
+ * The driver runs each file as an input, and with --random, runs random
+ * mutations of the files (or of built-in samples) as well.  Inputs slower
+ * than a second are reported, and the driver exits with a failure if there
+ * were any.  
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+#ifdef CONFIG_FUZZ_REPLAY
+#include <ctype.h>
+#include <stdlib.h>
+#include <fstream>
+#include <iterator>
+#include <random>
+#endif
+
+#include "configuration.h"
+#include "arena.h"
+#include "loader.h"
+
+/**
+ * \brief Reads a virtual file in chunks of a fixed size
+ */
+static configChunkReader readChunks(string_view text, size_t chunk) {
+  shared_ptr<size_t> pos = make_shared<size_t>(0);
+  return [text, chunk, pos](char *buffer, size_t size) {
+    size_t n = min(min(size, chunk), text.size() - *pos);
+    memcpy(buffer, text.data() + *pos, n);
+    *pos += n;
+    return (long)n;
+  };
+}
+
+static void fuzzParseValue(string_view input) {
+  size_t typeEnd = input.find('\n');
+  if (typeEnd == string_view::npos)
+    return;
+  string_view type = input.substr(0, typeEnd);
+  string_view text = input.substr(typeEnd + 1);
+  text = text.substr(0, text.find('\n'));
+
+  configArena arena(64);
+  configValue value;
+  if (parseValue(type, text, value, arena) != PARSE_OK)
+    return;
+  // Touch every element, for the sanitizers
+  volatile size_t sum = 0;
+  if (value.type == CONFIG_STRING_ARRAY) {
+    const string_view *elements = (const string_view *)value.arrayVal;
+    for (unsigned i = 0; i < value.length; i++)
+      sum += elements[i].size() != 0? (unsigned char)elements[i][0] : 0;
+  }
+  else if (value.type >= CONFIG_INT_ARRAY) {
+    for (unsigned i = 0; i < value.length; i++)
+      sum += ((const unsigned char *)value.arrayVal)[i];
+  }
+  else if (value.type == CONFIG_STRING && value.length != 0)
+    sum += (unsigned char)value.stringVal[value.length - 1];
+}
+
+static void fuzzLoad(string_view input, bool lazy, size_t chunk) {
+  vector<string_view> files;
+  for (size_t start = 0; ; ) {
+    size_t end = input.find('\0', start);
+    files.push_back(input.substr(start, end == string_view::npos? string_view::npos : end - start));
+    if (end == string_view::npos)
+      break;
+    start = end + 1;
+  }
+
+  Configuration::setLazyParsing(lazy);
+  vector<configError> errors = Configuration::tryLoadStream("0", readChunks(files[0], chunk),
+    [&files, chunk](const string &, string_view included, string &name) -> configChunkReader {
+      name = "missing " + string(included);
+      size_t index = 0;
+      for (char c : included) {
+        if (c < '0' || c > '9' || index > files.size())
+          return configChunkReader();
+        index = index * 10 + (c - '0');
+      }
+      if (included.empty() || index >= files.size())
+        return configChunkReader();
+      name = to_string(index);
+      return readChunks(files[index], chunk);
+    });
+  if (errors.empty() && lazy)
+    Configuration::get()->validateAll();
+  if (errors.empty()) {
+    ostringstream dumped;
+    Configuration::get()->dumpConfig(dumped);
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  string_view input((const char *)data, size);
+  fuzzParseValue(input);
+  unsigned mode = size != 0? data[0] : 0;
+  fuzzLoad(input, mode & 1, 1 + (mode >> 1) % 64);
+  return 0;
+}
+
+extern "C" int LLVMFuzzerInitialize(int *, char ***) {
+  // Redefinition warnings would flood the output
+  static ostringstream discard;
+  cerr.rdbuf(discard.rdbuf());
+  return 0;
+}
+
+#ifdef CONFIG_FUZZ_REPLAY
+// Keeps the NUL bytes separating virtual files
+#define SAMPLE(text) string(text, sizeof(text) - 1)
+
+static const string SAMPLES[] = {
+  SAMPLE("int A = 1\nstring B = \"x $C y\"\nstring C = \"z\"\n"),
+  SAMPLE("\nuse \"1\"\n[S.T]\nint[] A = [1, 2, 3]\nstring[] B = [\"a\", \"b#c\"]\n[]\nhex H = 0x1F\0double D = 1e300\n"),
+  SAMPLE("string\n\"a long value with # and \\\" characters\" # comment\n"),
+  SAMPLE("bool B = true\nchar C = 'x'\nuse \"1\"\0float F = -0.5\nuse \"2\"\0long L = -9000000000\n"),
+};
+
+/**
+ * \brief Mutates an input by inserting, deleting, replacing, and splicing bytes
+ */
+static string mutate(const string &input, mt19937 &rng) {
+  static const string tokens[] = {"use \"", "\"", "$", "#", "[", "]", ",", "=", "\n", string(1, '\0'),
+                                  "int", "string", "[]", "hex", ".", "'", "\\"};
+  string result = input;
+  for (unsigned n = 1 + rng() % 8; n > 0; n--) {
+    size_t pos = result.empty()? 0 : rng() % (result.size() + 1);
+    switch (rng() % 5) {
+    case 0: result.insert(pos, 1, (char)rng()); break;
+    case 1: if (pos < result.size()) result.erase(pos, 1 + rng() % 4); break;
+    case 2: if (pos < result.size()) result[pos] = (char)rng(); break;
+    case 3: {
+      result.insert(pos, tokens[rng() % (sizeof(tokens) / sizeof(tokens[0]))]);
+      break;
+    }
+    case 4: if (!result.empty()) result.insert(pos, result.substr(rng() % result.size(), rng() % 64)); break;
+    }
+  }
+  return result;
+}
+
+/**
+ * \brief Runs an input, checking how long it takes
+ * \return false if it was too slow
+ */
+static bool run(const string &input, const string &label) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.size());
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  if (seconds < 1)
+    return true;
+  cout << "Slow input " << label << ": " << seconds << " s" << endl;
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+  LLVMFuzzerInitialize(&argc, &argv);
+  unsigned long runs = 0;
+  unsigned seed = 1;
+  vector<string> inputs, labels;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--random") == 0 && i + 1 < argc) {
+      runs = strtoul(argv[++i], NULL, 10);
+      if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]))
+        seed = strtoul(argv[++i], NULL, 10);
+      continue;
+    }
+    ifstream in(argv[i], ios::binary);
+    if (!in) {
+      cout << "Could not read " << argv[i] << endl;
+      return 1;
+    }
+    inputs.emplace_back(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    labels.push_back(argv[i]);
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < inputs.size(); i++)
+    ok &= run(inputs[i], labels[i]);
+  if (inputs.empty())
+    inputs.assign(begin(SAMPLES), end(SAMPLES));
+
+  mt19937 rng(seed);
+  for (unsigned long r = 0; r < runs; r++) {
+    string input = mutate(inputs[rng() % inputs.size()], rng);
+    if (!run(input, "from --random " + to_string(runs) + " " + to_string(seed) + " at run " + to_string(r)))
+      ok = false;
+  }
+  cout << inputs.size() << " inputs and " << runs << " mutations run" << endl;
+  return ok? 0 : 1;
+}
+#endif
@@ -23,8 +23,15 @@
  *  </tr>
  *  <tr>
  *    <td>int</td>
- *    <td>[0-9]+</td>
- *    <td>42</td>
+ *    <td>-?[0-9]+</td>
+ *    <td>42, -42</td>
+ *    <td>A 32-bit signed integer</td>
+ *  </tr>
+ *  <tr>
+ *    <td>long</td>
+ *    <td>-?[0-9]+</td>
+ *    <td>42, -9000000000</td>
+ *    <td>A 64-bit signed integer</td>
  *  </tr>
  *  <tr>
  *    <td>hex</td>
@@ -33,15 +40,21 @@
  *    <td>It is recommended to use the 0x prefix and upper case A-F</td>
  *  </tr>
  *  <tr>
- *    <td>hex</td>
+ *    <td>octal</td>
  *    <td>[0-7]+</td>
  *    <td>0123, 123</td>
  *    <td>It is recommended to use the 0 prefix</td>
  *  </tr>
  *  <tr>
  *    <td>float</td>
- *    <td>[0-9]+(.[0-9]+)?</td>
- *    <td>3, 3.14</td>
+ *    <td>-?[0-9]+(.[0-9]+)?(e-?[0-9]+)?</td>
+ *    <td>3, 3.14, -1e-3</td>
+ *  </tr>
+ *  <tr>
+ *    <td>double</td>
+ *    <td>-?[0-9]+(.[0-9]+)?(e-?[0-9]+)?</td>
+ *    <td>3, 3.14159265358979, 1e300</td>
+ *    <td>A double precision float</td>
  *  </tr>
  *  <tr>
  *    <td>bool/boolean</td>
@@ -53,14 +66,21 @@
  *    <td>string</td>
  *    <td>\"[^\"\\n]*\"</td>
  *    <td>"Hello, World!  ", "", "$OTHER"</td>
- *    <td>$ followed by a variable is expanded to that variable.  
- *        An actual $ must be escaped</td>
+ *    <td>$ followed by a variable is expanded to that variable when the
+ *        configuration is loaded.  An actual $ must be escaped</td>
  *  </tr>
  *  <tr>
  *    <td>char</td>
  *    <td>'([^\\n\\r\\t]|\\\\n|\\\\r|\\\\t)'</td>
  *    <td>'a', 'A', '4', '\\n', '\\t'</td>
  *  </tr>
+ *  <tr>
+ *    <td>int[], long[], float[], double[], string[]</td>
+ *    <td>\[(value(, *value)*)?\]</td>
+ *    <td>[1, 2, 3], [0.1, 0.2], ["a", "b"], []</td>
+ *    <td>Elements have the syntax of the element type, and strings must be
+ *        quoted.  $ is not expanded in string elements</td>
+ *  </tr>
  * </table><br>
  * In addition to variable settings, it is possible to load other configuration
  * files.  This has the syntax:<br>
@@ -69,46 +89,774 @@
  * directory containing the current file - absolute paths are not permitted.  
  * When an included file contains a variable with the same name as a value
  * that is already defined, the current behavior is to overwrite the old value.  
- * Any value re-definition causes a warning.  
+ * Any value re-definition causes a warning.  A file that is included several
+ * times, such as a common base of several files, is read and parsed once per
+ * load, and a file that includes itself, directly or through other files, is
+ * an error.  <br>
+ * Values can be grouped into sections with a header line<br>
+ * [\<section\>]<br>
+ * where section is one or more names separated by dots, such as NET.RX.  The
+ * settings after the header, up to the next header or the end of the file, are
+ * named \<section\>.\<name\>, and a [] header returns to the top level.  
+ * Sections do not extend into included files.  Configuration::scope gives a
+ * Configuration::View of the values in a section, which looks them up by the
+ * rest of their name and can iterate over them.  <br>
+ * Values that are read repeatedly can be resolved once with
+ * Configuration::lookup, which returns a Configuration::Handle that gives
+ * direct access to the stored value.  The GET_* macros cache such a handle at
+ * each call site.  Configuration::fill copies a list of values into variables
+ * at once, reporting every missing value together, and a
+ * Configuration::Binder does the same for the members of a struct, resolving
+ * them once for every struct it fills.  Configuration::setReadCache keeps a
+ * per-thread cache of the values recently read by name.  <br>
+ * Configuration::loadStream reads a configuration from a pipe, socket, or
+ * other stream instead, parsing it as it arrives.  <br>
+ * Configuration::forEach visits every value in order of name, and
+ * Configuration::dumpConfig writes them out as a configuration file or in
+ * compiled form, as the dump_config tool does.  <br>
+ * Configuration files are mapped into memory, so processes loading the same
+ * file share its pages, and must be replaced by renaming a new file over them
+ * rather than edited in place; Configuration::setInPlaceEdits copies them
+ * instead.  <br>
+ * Configuration::watch reloads the configuration when its files change, and
+ * Configuration::subscribe registers callbacks for changes to single values,
+ * and Configuration::subscribeChanges for the Configuration::Diff of every
+ * refresh, listing the values added, removed, and changed.  
+ * <br>
+ * Errors in the configuration files or command line exit the program when
+ * first loading, and a missing value exits when it is read.  The try*
+ * functions report them instead: Configuration::tryInitConfig and
+ * Configuration::tryRefresh return a list of configErrors, and
+ * Configuration::tryGet returns an empty optional for a missing value.  A
+ * reload with errors keeps the previous configuration.  <br>
+ * With Configuration::setLazyParsing, values are only parsed when first read,
+ * and Configuration::validateAll checks the rest.  <br>
+ * A process can load the configuration once for many others:
+ * Configuration::publishShared places it in POSIX shared memory, and
+ * processes that call Configuration::attachShared read it from there in
+ * place, without touching the files.  <br>
+ * When the library and program are built with CONFIG_STATS (make STATS=1),
+ * lookups are counted and loads are timed, and Configuration::dumpStats
+ * prints the results.  Otherwise the instrumentation compiles to nothing.  
  */
  
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <iosfwd>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
+
+/**
+ * \brief The type of a stored configuration value.  
+ * \details hex and octal values are stored as CONFIG_INT, and boolean values
+ * as CONFIG_BOOL.  New types are added at the end, since the values are
+ * stored in compiled configurations.  
+ */
+enum configType : unsigned char {
+  CONFIG_INT,
+  CONFIG_FLOAT,
+  CONFIG_CHAR,
+  CONFIG_BOOL,
+  CONFIG_STRING,
+  CONFIG_LONG,
+  CONFIG_DOUBLE,
+  CONFIG_INT_ARRAY,
+  CONFIG_LONG_ARRAY,
+  CONFIG_FLOAT_ARRAY,
+  CONFIG_DOUBLE_ARRAY,
+  CONFIG_STRING_ARRAY
+};
+
+/**
+ * \brief Gets the type name used in config files for a configType
+ * \param type The type
+ * \return The name ("int", "float", "char", "bool", "string", "long", "double",
+ * or the element type name followed by [] for arrays)
+ */
+const char *configTypeName(configType type);
+
+/**
+ * \brief The result of parsing a value.  
+ */
+enum parseStatus {
+  PARSE_OK,
+  PARSE_INVALID_TYPE_NAME,
+  PARSE_INVALID_SYNTAX
+};
+
+/**
+ * \brief The kind of an error found when loading a configuration.  
+ */
+enum configErrorKind {
+  CONFIG_ERROR_MISSING_FILE,
+  CONFIG_ERROR_SYNTAX,
+  CONFIG_ERROR_ARGUMENT,
+  CONFIG_ERROR_TYPE_MISMATCH,
+  CONFIG_ERROR_MISSING_VALUE,
+  CONFIG_ERROR_UNRESOLVED,
+  CONFIG_ERROR_SHARED_SEGMENT,
+  CONFIG_ERROR_READ,
+  CONFIG_ERROR_INCLUDE_CYCLE
+};
+
+/**
+ * \brief An error found when loading a configuration.  
+ */
+struct configError {
+  configErrorKind kind;
+
+  /**
+   * The file containing the error, or the name of the variable for errors in
+   * command line arguments and errors in values, or the name of a shared
+   * configuration.  
+   */
+  std::string source;
+
+  /** The line of the error in the file, or 0.  */
+  int line;
+
+  /**
+   * A description of the error, empty for missing or unreadable files and
+   * missing values, the text
+   * of an unresolved string, what failed for a shared configuration, or the
+   * chain of files of an include cycle.  
+   */
+  std::string description;
+
+  /**
+   * \brief Formats the error as a message
+   * \return The message
+   */
+  std::string message() const;
+};
 
 /**
  * \brief This struct holds a configuration value of any legal type.  
  * \details Note that stringVal is stored as a const char * in the union due to
- * restrictions in C++ not allowing complex types in unions.  The string is
- * converted to a char * after it is parsed, and is converted back in
- * getStringVal.  
+ * restrictions in C++ not allowing complex types in unions.  It points into
+ * storage owned by the ConfigTable holding the value (usually the mapped
+ * config file), and is not null-terminated; its length is stored separately.  
  */
 typedef struct {
+  /** The type that is stored.  */
+  configType type;
+
+  /**
+   * Set for strings with $ references that could not be expanded when the
+   * configuration was loaded.  Reading one reports the error.  
+   */
+  bool unresolved;
+
   /**
-   * The name of the type that is stored ("int", "float", "char", "bool", or
-   * "string") or an error code from parsing ("invalid type name" or "invalid
-   * syntax").
+   * Set for values that are parsed when first read, when loading lazily (see
+   * Configuration::setLazyParsing).  arrayVal then points to the text of the
+   * value.  Values returned by lookups are always parsed.  
    */
-  std::string type;
+  bool unparsed;
+
+  /** The length of stringVal, or the number of elements of arrayVal.  */
+  unsigned length;
   
   /** An anonymous union of all possible types that can be stored.  */
   union {
     int intVal;
+    long long longVal;
     float floatVal;
+    double doubleVal;
     char charVal;
     bool boolVal;
     const char *stringVal;
+    /** The elements of an array, stored contiguously.  */
+    const void *arrayVal;
   };
 } configValue;
 
+#ifdef CONFIG_STATS
+/**
+ * \brief Counts the reads of a value by one thread, for Configuration::dumpStats.  
+ * \details Only the owning thread writes the counts, so they are updated with
+ * plain loads and stores; they are atomic only so that dumpStats can read them
+ * from another thread.  
+ */
+struct configCounter {
+  std::string name;
+  /** Where the value was read, or NULL for lookups by name.  */
+  const char *site;
+  std::atomic<unsigned long> reads;
+  std::atomic<unsigned long> misses;
+  /** The next counter of the same thread.  */
+  configCounter *next;
+
+  void add(bool miss) {
+    reads.store(reads.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (miss)
+      misses.store(misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+};
+#endif
+
+/**
+ * \brief A read-only view of the elements of an array value.  
+ * \details The elements are stored contiguously with the configuration they
+ * were read from, and stay valid for as long as it does.  
+ */
+template <typename T>
+class configArray {
+ public:
+  configArray() : elements(NULL), count(0) {}
+  configArray(const T *elements, size_t count) : elements(elements), count(count) {}
+
+  const T *data() const { return elements; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  const T &operator[](size_t i) const { return elements[i]; }
+  const T *begin() const { return elements; }
+  const T *end() const { return elements + count; }
+
+ private:
+  const T *elements;
+  size_t count;
+};
+
+/**
+ * \brief Maps a C++ type to the matching configType and extracts
+ * it from a configValue of the given configuration.  
+ * \details wrap creates a configValue holding a default value of the type.  
+ */
+template <typename T> struct configTraits;
+
+class Configuration;
+
+class configArena;
+class frozenTable;
+
+/**
+ * \brief A table of config values, along with the storage backing their strings.  
+ * \details Tables can only be moved, so that merging never copies a whole table
+ * by accident.  
+ */
+struct ConfigTable {
+  /**
+   * \param arenaSize The size of the first block of the arena
+   */
+  explicit ConfigTable(size_t arenaSize = 1024);
+
+  ConfigTable(ConfigTable &&) = default;
+  ConfigTable &operator=(ConfigTable &&) = default;
+  ConfigTable(const ConfigTable &) = delete;
+  ConfigTable &operator=(const ConfigTable &) = delete;
+
+  /**
+   * \brief Keeps the buffers of another table alive with this one, so values
+   * copied from it stay valid, and adds its sources
+   */
+  void keepStorage(const ConfigTable &other);
+
+  /** The values, by name.  Names point into the arena of some table.  */
+  std::unordered_map<std::string_view, configValue> values;
+
+  /** Owns the names added to this table, and strings that aren't in a file.  */
+  std::shared_ptr<configArena> arena;
+
+  /**
+   * Other buffers that names and string values point into, such as mapped
+   * files and the arenas of merged tables, kept alive with the table.  
+   */
+  std::vector<std::shared_ptr<const void>> storage;
+
+  /** The files the values were read from, starting with the including file.  */
+  std::vector<std::string> sources;
+};
+
+template <> struct configTraits<int> {
+  typedef int defaultType;
+  static const configType type = CONFIG_INT;
+  static int extract(const Configuration &, const configValue &v) { return v.intVal; }
+  static configValue wrap(int x) { configValue v = {}; v.type = type; v.intVal = x; return v; }
+};
+
+template <> struct configTraits<long long> {
+  typedef long long defaultType;
+  static const configType type = CONFIG_LONG;
+  static long long extract(const Configuration &, const configValue &v) { return v.longVal; }
+  static configValue wrap(long long x) { configValue v = {}; v.type = type; v.longVal = x; return v; }
+};
+
+template <> struct configTraits<long> {
+  typedef long defaultType;
+  static const configType type = CONFIG_LONG;
+  static long extract(const Configuration &, const configValue &v) { return (long)v.longVal; }
+  static configValue wrap(long x) { configValue v = {}; v.type = type; v.longVal = x; return v; }
+};
+
+template <> struct configTraits<float> {
+  typedef float defaultType;
+  static const configType type = CONFIG_FLOAT;
+  static float extract(const Configuration &, const configValue &v) { return v.floatVal; }
+  static configValue wrap(float x) { configValue v = {}; v.type = type; v.floatVal = x; return v; }
+};
+
+template <> struct configTraits<double> {
+  typedef double defaultType;
+  static const configType type = CONFIG_DOUBLE;
+  static double extract(const Configuration &, const configValue &v) { return v.doubleVal; }
+  static configValue wrap(double x) { configValue v = {}; v.type = type; v.doubleVal = x; return v; }
+};
+
+template <> struct configTraits<bool> {
+  typedef bool defaultType;
+  static const configType type = CONFIG_BOOL;
+  static bool extract(const Configuration &, const configValue &v) { return v.boolVal; }
+  static configValue wrap(bool x) { configValue v = {}; v.type = type; v.boolVal = x; return v; }
+};
+
+template <> struct configTraits<char> {
+  typedef char defaultType;
+  static const configType type = CONFIG_CHAR;
+  static char extract(const Configuration &, const configValue &v) { return v.charVal; }
+  static configValue wrap(char x) { configValue v = {}; v.type = type; v.charVal = x; return v; }
+};
+
+template <> struct configTraits<std::string> {
+  /** Defaults must be string literals, or otherwise outlive the program.  */
+  typedef std::string_view defaultType;
+  static const configType type = CONFIG_STRING;
+  static std::string extract(const Configuration &instance, const configValue &v);
+  static configValue wrap(std::string_view x) {
+    configValue v = {};
+    v.type = type;
+    v.stringVal = x.data();
+    v.length = x.size();
+    return v;
+  }
+};
+
+template <> struct configTraits<std::string_view> {
+  /** Defaults must be string literals, or otherwise outlive the program.  */
+  typedef std::string_view defaultType;
+  static const configType type = CONFIG_STRING;
+  static std::string_view extract(const Configuration &instance, const configValue &v);
+  static configValue wrap(std::string_view x) {
+    configValue v = {};
+    v.type = type;
+    v.stringVal = x.data();
+    v.length = x.size();
+    return v;
+  }
+};
+
+/**
+ * \brief The traits of configArray<T>, for an array type that stores elements of type T.  
+ */
+template <typename T, configType Type>
+struct configArrayTraits {
+  /** Defaults must outlive the program.  */
+  typedef configArray<T> defaultType;
+  static const configType type = Type;
+  static configArray<T> extract(const Configuration &, const configValue &v) {
+    return configArray<T>((const T *)v.arrayVal, v.length);
+  }
+  static configValue wrap(configArray<T> x) {
+    configValue v = {};
+    v.type = type;
+    v.arrayVal = x.data();
+    v.length = x.size();
+    return v;
+  }
+};
+
+template <> struct configTraits<configArray<int>> : configArrayTraits<int, CONFIG_INT_ARRAY> {};
+template <> struct configTraits<configArray<long long>> : configArrayTraits<long long, CONFIG_LONG_ARRAY> {};
+template <> struct configTraits<configArray<float>> : configArrayTraits<float, CONFIG_FLOAT_ARRAY> {};
+template <> struct configTraits<configArray<double>> : configArrayTraits<double, CONFIG_DOUBLE_ARRAY> {};
+template <> struct configTraits<configArray<std::string_view>> :
+  configArrayTraits<std::string_view, CONFIG_STRING_ARRAY> {};
+
+/**
+ * \brief How a value differs between two configurations.  
+ */
+enum configChangeKind {
+  CONFIG_ADDED,
+  CONFIG_REMOVED,
+  CONFIG_CHANGED
+};
+
+/**
+ * \brief A value that differs between two configurations, see
+ * Configuration::diff.  
+ */
+struct configChange {
+  configChangeKind kind;
+  /** The name, which points into the configuration it is in.  */
+  std::string_view name;
+};
+
+/**
+ * \brief The format Configuration::dumpConfig writes values in.  
+ */
+enum configDumpFormat {
+  /** The syntax of a configuration file.  */
+  CONFIG_DUMP_TEXT,
+  /** The format written by Configuration::compileConfig.  */
+  CONFIG_DUMP_BINARY
+};
+
+/**
+ * \brief Reads the next chunk of a streamed configuration, see
+ * Configuration::loadStream.  
+ * \details Called with a buffer and its size, and returns the number of bytes
+ * written to it, 0 at the end of the input, or -1 if the input could not be
+ * read.  May return fewer bytes than fit, such as those that have arrived so
+ * far.  
+ */
+typedef std::function<long(char *buffer, size_t size)> configChunkReader;
+
+/**
+ * \brief Opens the configurations included by use lines of a streamed
+ * configuration.  
+ * \details Called with the name of the including configuration and the
+ * filename given by its use line.  Sets name to the name of the included
+ * configuration, which appears in errors and is passed to the resolver for
+ * its own includes, and returns a reader for it, or an empty function if it
+ * does not exist.  
+ */
+typedef std::function<configChunkReader(const std::string &including, std::string_view included,
+                                        std::string &name)> configIncludeResolver;
+
+/**
+ * \brief Reads a configuration from a file descriptor, such as a pipe or socket
+ * \param fd The file descriptor, which is not closed
+ */
+configChunkReader configReadFd(int fd);
+
+/**
+ * \brief Reads a configuration from an istream, which must outlive the reader
+ */
+configChunkReader configReadStream(std::istream &in);
+
+/**
+ * \brief Resolves includes as files relative to the directory of the
+ * including configuration, the same as for configuration files
+ */
+configIncludeResolver configFileResolver();
+
+/**
+ * \brief The number of lookups served by the read cache, see
+ * Configuration::setReadCache.  
+ */
+struct configCacheStats {
+  unsigned long hits;
+  unsigned long misses;
+};
+
+/**
+ * \brief A value to copy into a variable with Configuration::fill.  
+ * \details Create with configBind.  
+ */
+struct configBinding {
+  const char *name;
+  configType type;
+  void *destination;
+  /** Extracts the value into the destination.  */
+  void (*store)(const Configuration &instance, const configValue &value, void *destination);
+};
+
+/**
+ * \brief Describes a value to copy into a variable with Configuration::fill
+ * \param name The name of the value
+ * \param destination The variable, of any type the getters return
+ * \return The binding
+ */
+template <typename T>
+configBinding configBind(const char *name, T &destination) {
+  return configBinding{name, configTraits<T>::type, &destination,
+    [](const Configuration &instance, const configValue &value, void *destination) {
+      *(T *)destination = configTraits<T>::extract(instance, value);
+    }};
+}
+
 // Configuration Class
 class Configuration {  
  public:
+  template <typename T> class Handle;
+  template <typename T> class Key;
+  template <typename S> class Binder;
+  class View;
+  class Diff;
+
+  ~Configuration();
+
   static void initConfig(const std::string &filename);
+
+  /**
+   * \brief Sets up the configuration from the command line
+   * \details The arguments recognized are<br>
+   * --use-config \<file\> to load file instead of defaultFilename<br>
+   * --add-config \<file\> to set the values in file<br>
+   * -D\<name\> \<type\> \<value\> to set a single value<br>
+   * \@\<file\> to read more arguments from file, separated by whitespace, with
+   * quotes to group them and # comments<br>
+   * and others are ignored.  Values set with -D take precedence over those in
+   * added files, which take precedence over files added after them and the
+   * configuration itself.  Exits on errors.  
+   * \param defaultFilename The file to load without --use-config
+   */
   static void initConfig(int argc, char *argv[], const std::string &defaultFilename);
 
+  /**
+   * \brief Sets up the configuration from the command line, like initConfig,
+   * without exiting on errors
+   * \details Arguments with errors are skipped.  
+   * \return The errors found, or an empty list
+   */
+  static std::vector<configError> tryInitConfig(int argc, char *argv[], const std::string &defaultFilename);
+
+  /**
+   * \brief Loads the configuration from a stream instead of a file, replacing
+   * the current one
+   * \details Lines are parsed as they arrive, so parsing overlaps reading.  The
+   * configuration replaces the current one like a refresh, and command line
+   * settings apply to it as usual.  refresh() keeps it until initConfig or
+   * attachShared selects a file or shared configuration again.  Exits on
+   * errors.  
+   * \param name The name of the configuration, used in errors and passed to
+   * the resolver
+   * \param reader The chunks of the configuration, such as from configReadFd
+   * \param resolver Opens the configurations it includes, by default as files
+   */
+  static void loadStream(const std::string &name, configChunkReader reader,
+                         configIncludeResolver resolver = configFileResolver());
+
+  /**
+   * \brief Loads the configuration from a stream, like loadStream, without
+   * exiting on errors
+   * \details If there are errors, the current configuration is kept.  
+   * \return The errors found, or an empty list if the configuration was loaded
+   */
+  static std::vector<configError> tryLoadStream(const std::string &name, configChunkReader reader,
+                                                configIncludeResolver resolver = configFileResolver());
+
+  /**
+   * \brief Compiles a configuration file and its includes into a binary file
+   * \details The compiled file is used by later loads of the configuration
+   * file until any of the files it was compiled from change.  
+   * \param filename The configuration file
+   * \param compiledFilename The file to write, by default filename with
+   * COMPILED_CONFIG_SUFFIX (".bin") appended
+   * \return false if the compiled file could not be written
+   */
+  static bool compileConfig(const std::string &filename, const std::string &compiledFilename = "");
+
+  /**
+   * \brief Sets if values are parsed when they are first read, rather than
+   * when the configuration is loaded
+   * \details Loading then only checks the names and types of values, so that
+   * its cost depends on the values that are read rather than the size of the
+   * files.  A value is parsed once, the first time it is read from a
+   * configuration.  Strings are always parsed when loading, for expanding $
+   * references, and values from the command line or a compiled configuration
+   * are already parsed.  A value with a syntax error is reported when it is
+   * read, like a missing value; validateAll finds all of them.  Takes effect
+   * on the next load or refresh.  
+   * \param lazy If values are parsed lazily
+   */
+  static void setLazyParsing(bool lazy);
+
+  /**
+   * \brief Sets if configuration files may be edited in place while a
+   * configuration loaded from them is in use
+   * \details Files are mapped into memory by default, and string values point
+   * into the mappings, so that processes loading the same file share its
+   * pages.  A mapped file must then be replaced by writing a new file and
+   * renaming it over the old one, since truncating it makes reading the
+   * strings of configurations still in use fault.  With in-place edits, files
+   * are copied into memory instead, at the cost of a private copy in each
+   * process.  Compiled files and shared configurations are always mapped.  
+   * Takes effect on the next load or refresh.  
+   * \param inPlace If files are copied rather than mapped
+   */
+  static void setInPlaceEdits(bool inPlace);
+
+  /**
+   * \brief Sets if values read by name are cached per thread
+   * \details Each thread then keeps a small direct-mapped cache of the values
+   * it recently read by name with the get*Config functions, tryGet, hasConfig,
+   * and fill, so that reading a hot value only touches memory owned by the
+   * thread.  The cache is invalidated by every refresh.  Off by default.  
+   * \param enabled If values are cached
+   */
+  static void setReadCache(bool enabled);
+
+  /**
+   * \brief Gets the number of lookups by name served from and missing the read
+   * cache, summed over all threads, while it was enabled
+   */
+  static configCacheStats readCacheStats();
+
+  /**
+   * \brief Publishes the configuration to POSIX shared memory, loading it if
+   * needed
+   * \details The configuration is stored in its compiled form, which holds
+   * offsets rather than pointers, in a new segment for every publish.  Every
+   * later refresh that loads a new configuration publishes it as well, and
+   * attached processes pick it up on their next refresh.  Only one process
+   * should publish to a name.  
+   * \param name The name of the shared configuration, such as "myapp"
+   */
+  static void publishShared(const std::string &name);
+
+  /**
+   * \brief Publishes the configuration to shared memory, like publishShared,
+   * without exiting on errors
+   * \details Values with syntax errors are reported here when parsing lazily
+   * (see setLazyParsing), and nothing is published.  
+   * \return The errors found, or an empty list if the configuration was
+   * published
+   */
+  static std::vector<configError> tryPublishShared(const std::string &name);
+
+  /**
+   * \brief Reads the configuration from shared memory instead of the files
+   * \details Loads map the configuration last published with publishShared
+   * read-only, and values are looked up in place, through a hash table stored
+   * with them, so attaching builds nothing and every attached process shares
+   * the same pages.  The values are those of the publishing process, including
+   * its command line settings, so those of this process are not applied.  A
+   * refresh loads a newly published configuration if there is one, and watch()
+   * checks for one every delay.  Takes effect on the next load or refresh.  
+   * \param name The name the configuration was published as, or "" to go back
+   * to reading the files
+   */
+  static void attachShared(const std::string &name);
+
+  /**
+   * \brief Gets the current configuration, loading it if needed
+   * \details The pointer stays valid until the calling thread calls get()
+   * again after a refresh.  
+   * \return The configuration
+   */
   static Configuration* get();
+
+  /**
+   * \brief Reloads the configuration, if it has been loaded
+   * \details Readers keep using the old configuration until the new one is
+   * published.  Only files that changed since the last load are parsed again,
+   * and if none did, the current configuration is kept.  If the new
+   * configuration has errors, they are reported and the current configuration
+   * is kept.  
+   */
   static void refresh();
 
+  /**
+   * \brief Loads the configuration, or reloads it if it has been loaded,
+   * without exiting on errors
+   * \details Like refresh(), nothing is loaded if no file changed since the
+   * last load.  If loading fails, the current configuration (if any) is kept,
+   * and the same files are not loaded again until they change.  
+   * \return The errors found, or an empty list if the configuration was loaded
+   * or nothing changed
+   */
+  static std::vector<configError> tryRefresh();
+
+  /**
+   * \brief Starts reloading the configuration in the background when any of
+   * its files change
+   * \details The root file and every file it includes are watched, with
+   * inotify where available and by polling otherwise.  Bursts of changes are
+   * coalesced into a single refresh.  Calling this again restarts the watcher
+   * with the new delay.  
+   * \param delayMs How long to wait for further changes before reloading, or
+   * how often to check for changes when polling
+   */
+  static void watch(unsigned delayMs = 100);
+
+  /**
+   * \brief Stops watching the configuration files
+   */
+  static void unwatch();
+
+  /**
+   * \brief Registers a function to call when a value changes
+   * \details After every refresh, the callback is called on the refreshing
+   * thread if the value differs from that in the previous configuration,
+   * including being added or removed.  The new configuration is already
+   * published when it is called.  
+   * \param name The name of the value
+   * \param callback The function to call
+   * \return An id for unsubscribe()
+   */
+  static unsigned subscribe(const std::string &name, std::function<void()> callback);
+
+  /**
+   * \brief Removes a callback registered with subscribe()
+   * \param id The id returned by subscribe()
+   */
+  static void unsubscribe(unsigned id);
+
+  /**
+   * \brief Registers a function to call with the changes made by each refresh
+   * \details After every refresh that changes any value, the callback is
+   * called on the refreshing thread with the differences from the previous
+   * configuration, which is kept alive until it returns.  The difference is
+   * computed once for all such callbacks.  
+   * \param callback The function to call
+   * \return An id for unsubscribe()
+   */
+  static unsigned subscribeChanges(std::function<void(const Diff &)> callback);
+
+  /**
+   * \brief Finds the values that differ from an earlier configuration
+   * \details Compares the values by name.  Values from a file that did not
+   * change point to the same text, and are known to be equal without reading
+   * it; others are compared by value.  The result refers to both
+   * configurations, which must outlive it.  
+   * \param previous The earlier configuration
+   * \return The values added, removed, and changed since previous
+   */
+  Diff diff(const Configuration &previous) const;
+
+  /**
+   * \brief Calls a function with every value, in order of name
+   * \details The order is found the first time a configuration is visited,
+   * scoped, or dumped, after which visiting allocates nothing.  When loading
+   * lazily, values are parsed as they are visited, and a value with a syntax
+   * error is passed unparsed, as in a View.  For example:<br>
+   * config->forEach([](std::string_view name, const configValue &value) {
+   * ... });
+   * \param visit Called with the name and value of each value
+   */
+  template <typename F>
+  void forEach(F &&visit) const {
+    visitSorted([](void *context, std::string_view name, const configValue &value) {
+      (*(std::remove_reference_t<F> *)context)(name, value);
+    }, (void *)&visit);
+  }
+
+  /**
+   * \brief Writes every value, in order of name
+   * \details CONFIG_DUMP_TEXT writes a configuration file that loads to the
+   * same values: one type NAME = value line for each, under [section] headers
+   * for names in sections, without the includes and comments of the files it
+   * was loaded from.  A value that cannot be written in that syntax, such as a
+   * string containing a quote, is written as a comment naming it.  Values with
+   * syntax errors are written with the text they had in the file.<br>
+   * CONFIG_DUMP_BINARY writes the values as stored, in the format of
+   * compileConfig but without the versions of the files they were read from,
+   * so a load never takes it for an up to date compiled file.  Values with
+   * syntax errors are left out.  
+   * \param out The stream to write to
+   * \param format The format to write
+   * \return false if any value could not be written, or writing failed
+   */
+  bool dumpConfig(std::ostream &out, configDumpFormat format = CONFIG_DUMP_TEXT) const;
+
   // Functions to get config values
   /**
    * \brief Looks up an int
@@ -124,6 +872,20 @@ class Configuration {
    */
   float getFloatConfig(const std::string &name);
 
+  /**
+   * \brief Looks up a long
+   * \param name The name of the value
+   * \return The value
+   */
+  long long getLongConfig(const std::string &name);
+
+  /**
+   * \brief Looks up a double
+   * \param name The name of the value
+   * \return The value
+   */
+  double getDoubleConfig(const std::string &name);
+
   /**
    * \brief Looks up a boolean
    * \param name The name of the value
@@ -146,6 +908,13 @@ class Configuration {
    */
   std::string getStringConfig(const std::string &name);
 
+  /**
+   * \brief Looks up a string without copying it
+   * \param name The name of the value
+   * \return The value, valid as long as this configuration
+   */
+  std::string_view getStringView(const std::string &name);
+
   /**
    * \brief Checks if a config value exists
    * \param name The name of the value
@@ -153,23 +922,705 @@ class Configuration {
    */
   bool hasConfig(const std::string &name);
 
- private:
   /**
-   * \brief A type alias for an unordered map containing strings mapped to configValues.  
+   * \brief Looks up an int array
+   * \param name The name of the value
+   * \return A view of the elements, valid for as long as this configuration
+   */
+  configArray<int> getIntArray(const std::string &name);
+
+  /**
+   * \brief Looks up a long array
+   * \param name The name of the value
+   * \return A view of the elements, valid for as long as this configuration
+   */
+  configArray<long long> getLongArray(const std::string &name);
+
+  /**
+   * \brief Looks up a float array
+   * \param name The name of the value
+   * \return A view of the elements, valid for as long as this configuration
+   */
+  configArray<float> getFloatArray(const std::string &name);
+
+  /**
+   * \brief Looks up a double array
+   * \param name The name of the value
+   * \return A view of the elements, valid for as long as this configuration
+   */
+  configArray<double> getDoubleArray(const std::string &name);
+
+  /**
+   * \brief Looks up a string array
+   * \param name The name of the value
+   * \return A view of the elements, valid for as long as this configuration
+   */
+  configArray<std::string_view> getStringArray(const std::string &name);
+
+  /**
+   * \brief Parses every value that has not been parsed yet
+   * \details Only values loaded with setLazyParsing can have errors here.  
+   * \return The syntax errors found, or an empty list
    */
-  typedef std::unordered_map<std::string, configValue> ConfigTable;  
+  std::vector<configError> validateAll() const;
 
-  Configuration() {}; //Private constructor
+  /**
+   * \brief Looks up a value that may not exist, with a single lookup
+   * \param name The name of the value
+   * \return The value, or nothing if there is no value of type T with that
+   * name, or it is a string that could not be expanded
+   */
+  template <typename T>
+  std::optional<T> tryGet(const std::string &name) const {
+    const configValue *value = findValue(name, configTraits<T>::type);
+    if (value == NULL)
+      return std::nullopt;
+    return configTraits<T>::extract(*this, *value);
+  }
+
+  /**
+   * \brief Copies a list of values into variables, checking them all first
+   * \details Nothing is copied unless every value exists with the right type.  
+   * For example, to fill the fields of a struct:<br>
+   * config->tryFill({configBind("DEPTH", s.depth), configBind("NAME", s.name)})
+   * \param bindings The values and the variables to copy them into
+   * \return An error for every value that is missing, has another type, or is
+   * a string that could not be expanded, or an empty list
+   */
+  std::vector<configError> tryFill(std::initializer_list<configBinding> bindings) const;
+
+  /**
+   * \brief Copies a list of values into variables like tryFill, exiting after
+   * reporting all errors if any values are missing
+   */
+  void fill(std::initializer_list<configBinding> bindings) const;
+
+  /**
+   * \brief Gets the values whose names start with a prefix
+   * \details The values are found once, so lookups through the view compare
+   * only the rest of the name.  
+   * \param prefix A section name such as NET.RX, matching the values named
+   * NET.RX.*, or an empty string for all values
+   * \return The view, valid for as long as this configuration
+   */
+  View scope(std::string_view prefix) const;
+
+  /**
+   * \brief Resolves a config value once for repeated access
+   * \param name The name of the value
+   * \return A handle to the value, which is re-resolved after a refresh
+   */
+  template <typename T>
+  Handle<T> lookup(const std::string &name) {
+    Handle<T> handle(name);
+    handle.bind();
+    return handle;
+  }
+
+  /**
+   * \brief Looks up a value through a handle cached at the call site
+   * \details Site is only used to give each call site its own handle; the GET_*
+   * macros pass a fresh lambda.  Each thread has its own handle per site, which
+   * is rebound if the name passed at the site changes.  
+   * \param name The name of the value
+   * \return The value
+   */
+  template <typename T, typename Site, typename Name>
+  static T cached(Site, const Name &name, const char *site = NULL) {
+    static thread_local Handle<T> handle;
+#ifdef CONFIG_STATS
+    static thread_local configCounter *counter = NULL;
+    if (!handle.matches(name)) {
+      handle = Handle<T>(name);
+      counter = statsCounter(name, site != NULL? site : "unknown");
+    }
+    counter->add(false);
+#else
+    if (!handle.matches(name))
+      handle = Handle<T>(name);
+#endif
+    return handle.get();
+  }
+
+#ifdef CONFIG_STATS
+  /**
+   * \brief Prints the collected statistics
+   * \details This includes the number of lookups and misses of each value by
+   * name, the number of reads at each GET_* call site and of each CONFIG_KEY,
+   * and the time spent loading and parsing each file, most read first.  
+   * \param out The stream to print to
+   */
+  static void dumpStats(std::ostream &out);
+
+  /**
+   * \brief Prints the statistics periodically on a background thread
+   * \param intervalMs The time between prints, or 0 to stop printing
+   * \param out The stream to print to
+   */
+  static void logStats(unsigned intervalMs, std::ostream &out);
+#else
+  static void dumpStats(std::ostream &) {}
+  static void logStats(unsigned, std::ostream &) {}
+#endif
+
+ private:
+  Configuration(); //Private constructor
   ConfigTable config;
 
-  static Configuration *m_instance;
+  /**
+   * The values of config, rebuilt for lookups once loading finishes, after
+   * which config only holds the storage.  
+   */
+  std::unique_ptr<frozenTable> frozen;
+
+  const configValue &lookupValue(const std::string &name, configType type) const;
+
+  /**
+   * \brief Finds a value without reporting errors
+   * \return The value, or NULL if it is missing, has another type, or is an
+   * unresolved string
+   */
+  const configValue *findValue(const std::string &name, configType type) const;
+  void resolveStrings();
+  bool resolveString(std::string_view name, configValue &value,
+                     std::unordered_map<std::string_view, char> &state);
+  std::string_view stringValue(const configValue &value) const;
+  [[noreturn]] void reportUnresolved(std::string_view str, std::vector<std::string_view> &chain) const;
+
+  friend struct configTraits<std::string>;
+  friend struct configTraits<std::string_view>;
+
+  /**
+   * \brief Finds a value by name, counting the lookup with CONFIG_STATS
+   * \return The value, which may be unparsed, or NULL if it is missing
+   */
+  const configValue *findCounted(std::string_view name) const;
+
+  /**
+   * \brief Checks a value found for a binding, and parses it if needed
+   * \param value The value, or NULL if it is missing
+   * \param name The name used in errors
+   * \param errors The error is added to this if the value is missing, has
+   * another type, is an unresolved string, or has a syntax error
+   * \return The parsed value, or NULL if there was an error
+   */
+  const configValue *checkBinding(const configValue *value, configType type, const std::string &name,
+                                  std::vector<configError> &errors) const;
+
+  /**
+   * \brief Fills bindings with the values found by find, after checking all of them
+   * \param prefix Added to the names in errors
+   */
+  template <typename F>
+  static std::vector<configError> fillBindings(const Configuration &instance,
+                                               std::initializer_list<configBinding> bindings,
+                                               F find, const std::string &prefix);
+
+  /** The values parsed when first read, for a configuration loaded lazily.  */
+  struct lazyValues;
+  std::unique_ptr<lazyValues> lazy;
+
+  /**
+   * \brief Gets the parsed form of a value in the frozen table
+   * \param errors A syntax error is added to this, if not NULL
+   * \return The value, or NULL if it has a syntax error
+   */
+  const configValue *parsed(const configValue *value, std::vector<configError> *errors = NULL) const {
+    return value->unparsed? parseLazy(value, errors) : value;
+  }
+  const configValue *parseLazy(const configValue *value, std::vector<configError> *errors) const;
+
+  /**
+   * \brief Calls visit(context, name, value) for every value, in order of name
+   */
+  void visitSorted(void (*visit)(void *, std::string_view, const configValue &), void *context) const;
+
+  /**
+   * \brief Finds a value by name, through the read cache if it is enabled
+   * \return The value, or NULL if there is none with that name
+   */
+  const configValue *findName(std::string_view name) const;
+
+  /** Numbers the snapshots for the read cache, unique for the process.  */
+  unsigned long snapshot;
+
+  /**
+   * \brief Loads a new configuration
+   * \param errors The errors found are added to this
+   * \return The configuration, or NULL if there were errors
+   */
+  static Configuration *load(std::vector<configError> &errors);
+
+  /**
+   * \brief Finishes a new configuration once its values are read
+   * \details Applies the command line settings and expands strings unless the
+   * values came from a shared configuration, and freezes the table.  
+   * \param shared If the values came from a shared configuration
+   * \param errors The errors found are added to this
+   * \return false if there were errors
+   */
+  bool finishLoad(bool shared, std::vector<configError> &errors);
+
+  /**
+   * \brief Publishes a new configuration to readers, with instanceMutex held
+   * \param errors Errors republishing it to shared memory are added to this
+   */
+  static void install(const std::shared_ptr<Configuration> &instance, std::vector<configError> &errors);
+
+  /**
+   * \brief Publishes this configuration to shared memory
+   * \param name The name of the shared configuration
+   * \param errors The errors found are added to this
+   * \return false if there were errors
+   */
+  bool publish(const std::string &name, std::vector<configError> &errors) const;
+
+  /**
+   * \brief Prints errors and exits, if there are any
+   */
+  static void exitOnErrors(const std::vector<configError> &errors);
+
+  /**
+   * \brief Adds a key to the schema, or finds it if it was already added
+   * \return The slot of the key
+   */
+  static unsigned registerKey(const char *name, const configValue &defaultValue);
+
+  /**
+   * \brief Gets the value of a key registered after this configuration was loaded
+   */
+  configValue lateSlot(unsigned slot) const;
+
+  /**
+   * \brief Fills the slots from the frozen table, checking the types
+   * \return false if a type did not match
+   */
+  bool fillSlots(std::vector<configError> &errors);
+
+  /**
+   * \brief Gets the configuration held by this thread, checking that it is current
+   */
+  static Configuration *current() {
+    return isCurrent(localGeneration)? localPointer : get();
+  }
+
+  /**
+   * \brief Calls the subscribers of the values that differ between two
+   * configurations
+   */
+  static void notifySubscribers(const Configuration &previous, const Configuration &current);
+
+  /**
+   * \brief Checks if a value is the same in two configurations
+   */
+  static bool sameValue(const Configuration &a, const Configuration &b, const std::string &name);
+  static bool sameValue(const Configuration &a, const configValue *x, const Configuration &b,
+                        const configValue *y);
+
+#ifdef CONFIG_STATS
+  /**
+   * \brief Gets the counter of the calling thread for a value
+   * \param name The name of the value
+   * \param site Where it is read, or NULL for lookups by name
+   */
+  static configCounter *statsCounter(std::string_view name, const char *site);
+
+  /**
+   * \brief Gets the counter of the calling thread for a CONFIG_KEY
+   */
+  static configCounter *slotCounter(unsigned slot, const char *name);
+#endif
+
+  /** The values of the keys in the schema, by slot.  */
+  std::vector<configValue> slots;
+
+  /**
+   * \brief Checks if a generation is that of the current configuration, and is
+   * held by this thread
+   */
+  static bool isCurrent(unsigned long g) {
+    return g != 0 && g == localGeneration && g == generation.load(std::memory_order_acquire);
+  }
+
+  /** Only accessed with std::atomic_load and std::atomic_store.  */
+  static std::shared_ptr<Configuration> m_instance;
+  /** Incremented by every refresh, so that handles know when to re-resolve.  */
+  static std::atomic<unsigned long> generation;
+  /** The generation of the configuration last read by this thread.  */
+  static inline thread_local unsigned long localGeneration = 0;
+  /** The configuration last read by this thread.  */
+  static inline thread_local Configuration *localPointer = NULL;
   static std::string configFile;
-  static ConfigTable userDefs;
 };
  
-#define GET_INT(NAME) Configuration::get()->getIntConfig(NAME)
-#define GET_FLOAT(NAME) Configuration::get()->getFloatConfig(NAME)
-#define GET_BOOL(NAME) Configuration::get()->getBoolConfig(NAME)
-#define GET_CHAR(NAME) Configuration::get()->getCharConfig(NAME)
-#define GET_STRING(NAME) Configuration::get()->getStringConfig(NAME)
+/**
+ * \brief A resolved reference to a config value of type T.  
+ * \details The type is checked when the handle is resolved, after which get()
+ * is a single load.  A refresh invalidates the handle, and the next get()
+ * resolves it again against the new configuration.  A handle may be used from
+ * any thread, but is not itself synchronized.  
+ */
+template <typename T>
+class Configuration::Handle {
+ public:
+  Handle() : literal(NULL), instance(NULL), value(NULL), generation(0) {}
+  explicit Handle(const std::string &name) :
+    name(name), literal(NULL), instance(NULL), value(NULL), generation(0) {}
+  /** \brief Creates a handle for a string literal, which matches() compares by address */
+  template <std::size_t N>
+  explicit Handle(const char (&name)[N]) :
+    name(name), literal(name), instance(NULL), value(NULL), generation(0) {}
+
+  /**
+   * \brief Gets the value, resolving the name first if needed
+   * \return The value
+   */
+  T get() {
+    // The value is safe to read if it belongs to the configuration this thread holds
+    if (!Configuration::isCurrent(generation))
+      bind();
+    return configTraits<T>::extract(*instance, *value);
+  }
+
+  T operator*() { return get(); }
+
+  const std::string &getName() const { return name; }
+
+  /**
+   * \brief Checks if this handle was created for the given name
+   * \details A char array is taken to be a string literal, so one at the same
+   * address as the literal the handle was created for has the same name, and
+   * the names are only compared when the addresses differ.  
+   */
+  template <typename Name>
+  bool matches(const Name &other) const {
+    if (generation == 0)
+      return false;
+    if constexpr (std::is_array_v<Name>)
+      if (literal == other)
+        return true;
+    return name == other;
+  }
+
+ private:
+  friend class Configuration;
+
+  void bind() {
+    instance = Configuration::get();
+    value = &instance->lookupValue(name, configTraits<T>::type);
+    generation = Configuration::localGeneration;
+  }
+
+  std::string name;
+  const char *literal;
+  const Configuration *instance;
+  const configValue *value;
+  unsigned long generation;
+};
+
+/**
+ * \brief Copies config values into the members of a struct.  
+ * \details The members are described once, and the values are resolved on
+ * the first fill after every refresh, after which filling a struct only copies
+ * the values.  Like a Handle, a binder may be used from any thread, but is not
+ * itself synchronized, so a binder shared by threads should be thread_local.  
+ * For example:<br>
+ * static thread_local Configuration::Binder<rxSettings> binder =
+ *   Configuration::Binder<rxSettings>().bind("DEPTH", &rxSettings::depth);<br>
+ * binder.fill(settings);
+ */
+template <typename S>
+class Configuration::Binder {
+ public:
+  Binder() : instance(NULL), generation(0) {}
+
+  /**
+   * \brief Adds a member to fill
+   * \param name The name of the value
+   * \param member The member, of any type the getters return
+   * \return This binder
+   */
+  template <typename T>
+  Binder &bind(const std::string &name, T S::*member) {
+    members.push_back(binding{name, configTraits<T>::type,
+      [member](const Configuration &instance, const configValue &value, S &target) {
+        target.*member = configTraits<T>::extract(instance, value);
+      }});
+    generation = 0;
+    return *this;
+  }
+
+  /**
+   * \brief Fills the members of a struct, checking all values first
+   * \details Nothing is copied unless every value exists with the right type.  
+   * \param target The struct to fill
+   * \return An error for every value that is missing, has another type, or is
+   * a string that could not be expanded, or an empty list
+   */
+  std::vector<configError> tryFill(S &target) {
+    std::vector<configError> errors;
+    if (!Configuration::isCurrent(generation)) {
+      instance = Configuration::get();
+      values.clear();
+      bool ok = true;
+      for (const binding &b : members) {
+        const configValue *value = instance->checkBinding(instance->findCounted(b.name), b.type, b.name,
+                                                          errors);
+        ok = value != NULL && ok;
+        values.push_back(value);
+      }
+      if (!ok) {
+        generation = 0;
+        return errors;
+      }
+      generation = Configuration::localGeneration;
+    }
+    for (size_t i = 0; i < members.size(); i++)
+      members[i].store(*instance, *values[i], target);
+    return errors;
+  }
+
+  /**
+   * \brief Fills the members of a struct like tryFill, exiting after
+   * reporting all errors if any values are missing
+   */
+  void fill(S &target) {
+    Configuration::exitOnErrors(tryFill(target));
+  }
+
+ private:
+  struct binding {
+    std::string name;
+    configType type;
+    std::function<void(const Configuration &, const configValue &, S &)> store;
+  };
+
+  std::vector<binding> members;
+  const Configuration *instance;
+  /** The values of the members in instance.  */
+  std::vector<const configValue *> values;
+  unsigned long generation;
+};
+
+/**
+ * \brief The values of a configuration in a section.  
+ * \details Holds the names below the prefix, sorted, along with their values,
+ * so that a lookup is a binary search over the short names with no copying or
+ * hashing.  The view can also be iterated, in order of name.  Errors are
+ * reported with the full name, like the getters of Configuration.  
+ */
+class Configuration::View {
+ public:
+  /** \brief A value in the view */
+  struct entry {
+    /** The name without the prefix.  */
+    std::string_view name;
+    /** The value, parsed when the view is created unless it has a syntax error.  */
+    const configValue *value;
+  };
+
+  typedef std::vector<entry>::const_iterator iterator;
+
+  View() : instance(NULL) {}
+
+  /** \brief Gets the prefix of the names, including the trailing . */
+  const std::string &getPrefix() const { return prefix; }
+
+  size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+  iterator begin() const { return entries.begin(); }
+  iterator end() const { return entries.end(); }
+
+  /**
+   * \brief Gets the values in a section of this view
+   * \param prefix The name of the section relative to this view
+   */
+  View scope(std::string_view prefix) const;
+
+  /**
+   * \brief Checks if a value exists
+   * \param name The name of the value without the prefix
+   */
+  bool has(std::string_view name) const { return find(name) != NULL; }
+
+  /**
+   * \brief Looks up a value
+   * \param name The name of the value without the prefix
+   * \return The value
+   */
+  template <typename T>
+  T get(std::string_view name) const {
+    return configTraits<T>::extract(*instance, lookupValue(name, configTraits<T>::type));
+  }
+
+  /**
+   * \brief Looks up a value that may not exist
+   * \param name The name of the value without the prefix
+   * \return The value, or nothing if there is no value of type T with that
+   * name, or it is a string that could not be expanded
+   */
+  template <typename T>
+  std::optional<T> tryGet(std::string_view name) const {
+    const configValue *value = find(name);
+    if (value == NULL || value->type != configTraits<T>::type || value->unresolved ||
+        (value = instance->parsed(value)) == NULL)
+      return std::nullopt;
+    return configTraits<T>::extract(*instance, *value);
+  }
+
+  int getInt(std::string_view name) const { return get<int>(name); }
+  long long getLong(std::string_view name) const { return get<long long>(name); }
+  float getFloat(std::string_view name) const { return get<float>(name); }
+  double getDouble(std::string_view name) const { return get<double>(name); }
+  bool getBool(std::string_view name) const { return get<bool>(name); }
+  char getChar(std::string_view name) const { return get<char>(name); }
+  std::string getString(std::string_view name) const { return get<std::string>(name); }
+  std::string_view getStringView(std::string_view name) const { return get<std::string_view>(name); }
+
+  /**
+   * \brief Copies a list of values into variables, like Configuration::tryFill
+   * \details Names are relative to the prefix.  
+   */
+  std::vector<configError> tryFill(std::initializer_list<configBinding> bindings) const;
+
+  /**
+   * \brief Copies a list of values into variables, like Configuration::fill
+   */
+  void fill(std::initializer_list<configBinding> bindings) const;
+
+ private:
+  friend class Configuration;
+
+  const configValue *find(std::string_view name) const;
+  const configValue &lookupValue(std::string_view name, configType type) const;
+
+  const Configuration *instance;
+  std::string prefix;
+  std::vector<entry> entries;
+};
+
+/**
+ * \brief The values that differ between two configurations, from
+ * Configuration::diff.  
+ * \details The changes are sorted by name.  The typed getters read a value
+ * from either configuration, like Configuration::tryGet.  
+ */
+class Configuration::Diff {
+ public:
+  typedef std::vector<configChange>::const_iterator iterator;
+
+  iterator begin() const { return changes.begin(); }
+  iterator end() const { return changes.end(); }
+  size_t size() const { return changes.size(); }
+  bool empty() const { return changes.empty(); }
+
+  /**
+   * \brief Finds the change to a value
+   * \param name The name of the value
+   * \return The change, or NULL if the value is the same in both
+   */
+  const configChange *find(std::string_view name) const;
+
+  /** \brief Checks if a value differs between the configurations */
+  bool changed(std::string_view name) const { return find(name) != NULL; }
+
+  /** \brief Gets a value from the earlier configuration */
+  template <typename T>
+  std::optional<T> before(std::string_view name) const { return previous->tryGet<T>(std::string(name)); }
+
+  /** \brief Gets a value from the later configuration */
+  template <typename T>
+  std::optional<T> after(std::string_view name) const { return current->tryGet<T>(std::string(name)); }
+
+  const Configuration &getPrevious() const { return *previous; }
+  const Configuration &getCurrent() const { return *current; }
+
+ private:
+  friend class Configuration;
+
+  Diff(const Configuration &previous, const Configuration &current) : previous(&previous), current(&current) {}
+
+  const Configuration *previous;
+  const Configuration *current;
+  std::vector<configChange> changes;
+};
+
+inline std::string configTraits<std::string>::extract(const Configuration &instance, const configValue &v) {
+  return std::string(instance.stringValue(v));
+}
+
+inline std::string_view configTraits<std::string_view>::extract(const Configuration &instance, const configValue &v) {
+  return instance.stringValue(v);
+}
+
+/**
+ * \brief A config value declared in the schema with CONFIG_KEY.  
+ * \details Every loaded configuration holds the value of each key in a slot,
+ * set to the default if the value is not defined.  Reading a key checks that
+ * this thread's configuration is current and loads its slot, with no lookup
+ * or type check.  
+ */
+template <typename T>
+class Configuration::Key {
+ public:
+  /**
+   * \param name The name of the value
+   * \param defaultValue The value used if it is not defined
+   */
+  Key(const char *name, typename configTraits<T>::defaultType defaultValue) :
+    name(name), slot(Configuration::registerKey(name, configTraits<T>::wrap(defaultValue))) {}
+
+  /**
+   * \brief Gets the value
+   * \return The value
+   */
+  T get() const {
+#ifdef CONFIG_STATS
+    Configuration::slotCounter(slot, name)->add(false);
+#endif
+    Configuration *instance = Configuration::current();
+    if (slot < instance->slots.size())
+      return configTraits<T>::extract(*instance, instance->slots[slot]);
+    return configTraits<T>::extract(*instance, instance->lateSlot(slot));
+  }
+
+  T operator*() const { return get(); }
+
+  const char *getName() const { return name; }
+
+ private:
+  const char *name;
+  unsigned slot;
+};
+
+/**
+ * \brief Declares a config value in the schema
+ * \details Defines a Configuration::Key<TYPE> named NAME, for the value named
+ * NAME.  Use at namespace scope, typically in a header.  
+ */
+#define CONFIG_KEY(NAME, TYPE, DEFAULT) inline const Configuration::Key<TYPE> NAME(#NAME, DEFAULT)
+
+#define CONFIG(KEY) (KEY).get()
+
+// With CONFIG_STATS, the GET_* macros pass their location for dumpStats
+#ifdef CONFIG_STATS
+#define CONFIG_STRINGIFY(X) #X
+#define CONFIG_SITE_LINE(LINE) , __FILE__ ":" CONFIG_STRINGIFY(LINE)
+#define CONFIG_SITE CONFIG_SITE_LINE(__LINE__)
+#else
+#define CONFIG_SITE
+#endif
+
+#define GET_INT(NAME) Configuration::cached<int>([]{}, NAME CONFIG_SITE)
+#define GET_FLOAT(NAME) Configuration::cached<float>([]{}, NAME CONFIG_SITE)
+#define GET_LONG(NAME) Configuration::cached<long long>([]{}, NAME CONFIG_SITE)
+#define GET_DOUBLE(NAME) Configuration::cached<double>([]{}, NAME CONFIG_SITE)
+#define GET_BOOL(NAME) Configuration::cached<bool>([]{}, NAME CONFIG_SITE)
+#define GET_CHAR(NAME) Configuration::cached<char>([]{}, NAME CONFIG_SITE)
+#define GET_STRING(NAME) Configuration::cached<std::string>([]{}, NAME CONFIG_SITE)
+#define GET_INT_ARRAY(NAME) Configuration::cached<configArray<int>>([]{}, NAME CONFIG_SITE)
+#define GET_LONG_ARRAY(NAME) Configuration::cached<configArray<long long>>([]{}, NAME CONFIG_SITE)
+#define GET_FLOAT_ARRAY(NAME) Configuration::cached<configArray<float>>([]{}, NAME CONFIG_SITE)
+#define GET_DOUBLE_ARRAY(NAME) Configuration::cached<configArray<double>>([]{}, NAME CONFIG_SITE)
+#define GET_STRING_ARRAY(NAME) Configuration::cached<configArray<std::string_view>>([]{}, NAME CONFIG_SITE)
 #define DEFINED(NAME) Configuration::get()->hasConfig(NAME)
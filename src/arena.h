@@ -0,0 +1,53 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  arena.h
+ * \brief Bump allocator owning the strings of a ConfigTable.  
+ */
+
+#include <memory_resource>
+#include <string_view>
+#include <string.h>
+
+/**
+ * \brief A bump allocator for config names and string payloads.  
+ * \details Memory is handed out from a few large blocks and released all at
+ * once when the arena is destroyed, so a table with thousands of entries costs
+ * one allocation and one free when the initial size hint is large enough.  
+ */
+class configArena {
+ public:
+  /**
+   * \param initialSize The size of the first block
+   */
+  explicit configArena(size_t initialSize) : resource(initialSize) {}
+
+  configArena(const configArena &) = delete;
+  configArena &operator=(const configArena &) = delete;
+
+  /**
+   * \brief Allocates raw memory
+   * \param bytes The number of bytes
+   * \param align The required alignment
+   * \return The memory, valid for the lifetime of the arena
+   */
+  void *allocate(size_t bytes, size_t align) {
+    return resource.allocate(bytes, align);
+  }
+
+  /**
+   * \brief Copies a string into the arena, adding a null terminator
+   * \param text The string to copy
+   * \return The copy, not including the terminator
+   */
+  std::string_view copy(std::string_view text) {
+    char *result = (char *)allocate(text.size() + 1, 1);
+    memcpy(result, text.data(), text.size());
+    result[text.size()] = '\0';
+    return std::string_view(result, text.size());
+  }
+
+ private:
+  std::pmr::monotonic_buffer_resource resource;
+};
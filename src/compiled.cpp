@@ -0,0 +1,484 @@
+/**
+ * \author Lucas Kramer
+ * \file  compiled.cpp
+ * \brief Implementation of compiled configuration files.  
+ * \details See compiled.h for more information.  
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "compiled.h"
+#include "arena.h"
+#include "loader.h"
+#include "mapped_file.h"
+
+static const char COMPILED_MAGIC[8] = {'C', 'F', 'G', 'B', 'I', 'N', '\0', '\0'};
+
+/** Incremented whenever the layout changes.  */
+static const uint32_t COMPILED_VERSION = 4;
+
+struct compiledHeader {
+  char magic[8];
+  uint32_t version;
+  /** sizeof(compiledEntry), as a check that the layout matches.  */
+  uint32_t entrySize;
+  uint32_t numEntries;
+  uint32_t numSources;
+  /** The size of the string pool at the end of the image.  */
+  uint64_t stringsSize;
+  /** The seed of the perfect hash the entries are placed with.  */
+  uint64_t hashSeed;
+  /** The number of displacements of the perfect hash.  */
+  uint32_t numBuckets;
+  uint32_t padding;
+};
+
+/** \brief A range of the string pool.  */
+struct compiledString {
+  uint32_t offset;
+  uint32_t length;
+};
+
+/**
+ * \brief A file the values were read from, with the version that was read,
+ * or all zeros for images that are not checked against their files.  
+ */
+struct compiledSource {
+  compiledString name;
+  /** 1 if the version below is set.  */
+  uint32_t stamped;
+  uint32_t padding;
+  uint64_t device;
+  uint64_t inode;
+  uint64_t size;
+  int64_t modifiedSec;
+  int64_t modifiedNsec;
+};
+
+struct compiledEntry {
+  /** The hash of the name, with the seed in the header.  */
+  uint64_t hash;
+  compiledString name;
+  uint8_t type;
+  /** COMPILED_UNRESOLVED, for published configurations; always 0 in files.  */
+  uint8_t flags;
+  uint8_t padding[6];
+  /**
+   * The bits of the value, or for strings and arrays the offset into the
+   * string pool.  Numeric arrays are stored as their elements, and string
+   * arrays as a compiledString for each element.  
+   */
+  uint64_t payload;
+  /** The length of a string, or the number of elements of an array.  */
+  uint32_t length;
+  uint32_t padding2;
+};
+
+/** Set for strings whose references could not be expanded.  */
+static const uint8_t COMPILED_UNRESOLVED = 1;
+
+static_assert(sizeof(configValue) - offsetof(configValue, intVal) == sizeof(uint64_t),
+              "configValue payload must fit in compiledEntry::payload");
+
+// The file is laid out as the header, the sources (with the configuration file
+// first), the entries in the slots of the perfect hash, the displacements of
+// its buckets, the slots in order of name, and the string pool, aligned to 8
+// bytes.  
+
+static compiledString addString(string &pool, string_view str) {
+  compiledString result = {(uint32_t)pool.size(), (uint32_t)str.size()};
+  pool.append(str);
+  return result;
+}
+
+/** The pool starts 8-byte aligned in the file, so arrays are aligned within it.  */
+static const size_t ARRAY_ALIGNMENT = 8;
+
+/**
+ * \brief Gets the size of the elements of a numeric array type, or 0 for other types
+ */
+static size_t elementSize(configType type) {
+  switch (type) {
+  case CONFIG_INT_ARRAY: return sizeof(int);
+  case CONFIG_LONG_ARRAY: return sizeof(long long);
+  case CONFIG_FLOAT_ARRAY: return sizeof(float);
+  case CONFIG_DOUBLE_ARRAY: return sizeof(double);
+  default: return 0;
+  }
+}
+
+/**
+ * \brief Gets the size of the value of a scalar type
+ */
+static size_t scalarSize(configType type) {
+  switch (type) {
+  case CONFIG_INT: return sizeof(int);
+  case CONFIG_LONG: return sizeof(long long);
+  case CONFIG_FLOAT: return sizeof(float);
+  case CONFIG_DOUBLE: return sizeof(double);
+  case CONFIG_CHAR: return sizeof(char);
+  case CONFIG_BOOL: return sizeof(bool);
+  default: return 0;
+  }
+}
+
+static uint64_t addArray(string &pool, const void *data, size_t bytes) {
+  pool.resize((pool.size() + ARRAY_ALIGNMENT - 1) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT);
+  uint64_t offset = pool.size();
+  pool.append((const char *)data, bytes);
+  return offset;
+}
+
+bool compileValues(const vector<pair<string_view, configValue>> &values, const vector<string> &sources,
+                   const vector<fileStamp> &stamps, string &image) {
+  string pool;
+  vector<compiledSource> compiledSources;
+  for (size_t i = 0; i < sources.size(); i++) {
+    compiledSource source;
+    memset(&source, 0, sizeof(source));
+    source.name = addString(pool, sources[i]);
+    if (i < stamps.size() && stamps[i].exists) {
+      source.stamped = 1;
+      source.device = stamps[i].device;
+      source.inode = stamps[i].inode;
+      source.size = stamps[i].size;
+      source.modifiedSec = stamps[i].modified.tv_sec;
+      source.modifiedNsec = stamps[i].modified.tv_nsec;
+    }
+    compiledSources.push_back(source);
+  }
+
+  // Place the entries in the slots of a perfect hash, so that the image can be
+  // read in place
+  frozenTable table(unordered_map<string_view, configValue>(values.begin(), values.end()));
+  vector<compiledEntry> entries;
+  entries.reserve(table.size());
+  for (size_t i = 0; i < table.size(); i++) {
+    const frozenTable::entry &named = *table.at(i);
+    const configValue &value = named.value;
+    compiledEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.hash = named.hash;
+    entry.name = addString(pool, named.name);
+    entry.type = value.type;
+    entry.flags = value.unresolved? COMPILED_UNRESOLVED : 0;
+    if (value.type == CONFIG_STRING) {
+      compiledString str = addString(pool, string_view(value.stringVal, value.length));
+      entry.payload = str.offset;
+      entry.length = str.length;
+    }
+    else if (value.type == CONFIG_STRING_ARRAY) {
+      const string_view *elements = (const string_view *)value.arrayVal;
+      vector<compiledString> strings;
+      for (unsigned i = 0; i < value.length; i++)
+        strings.push_back(addString(pool, elements[i]));
+      entry.payload = addArray(pool, strings.data(), strings.size() * sizeof(compiledString));
+      entry.length = value.length;
+    }
+    else if (elementSize(value.type) != 0) {
+      entry.payload = addArray(pool, value.arrayVal, value.length * elementSize(value.type));
+      entry.length = value.length;
+    }
+    else {
+      // Only the bytes of the value, so the rest of the payload stays zero
+      memcpy(&entry.payload, &value.intVal, scalarSize(value.type));
+    }
+    entries.push_back(entry);
+  }
+  if (pool.size() > UINT32_MAX)
+    return false;
+
+  compiledHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, COMPILED_MAGIC, sizeof(header.magic));
+  header.version = COMPILED_VERSION;
+  header.entrySize = sizeof(compiledEntry);
+  header.numEntries = entries.size();
+  header.numSources = compiledSources.size();
+  header.stringsSize = pool.size();
+  header.hashSeed = table.getSeed();
+  header.numBuckets = table.getDisplacements().size();
+
+  const vector<uint32_t> &displacements = table.getDisplacements();
+  configArray<uint32_t> order = table.sortedOrder();
+  image.clear();
+  image.reserve(sizeof(header) + compiledSources.size() * sizeof(compiledSource) +
+                entries.size() * sizeof(compiledEntry) +
+                (displacements.size() + order.size() + 2) * sizeof(uint32_t) + pool.size());
+  image.append((const char *)&header, sizeof(header));
+  image.append((const char *)compiledSources.data(), compiledSources.size() * sizeof(compiledSource));
+  image.append((const char *)entries.data(), entries.size() * sizeof(compiledEntry));
+  image.append((const char *)displacements.data(), displacements.size() * sizeof(uint32_t));
+  image.append((const char *)order.data(), order.size() * sizeof(uint32_t));
+  image.resize((image.size() + ARRAY_ALIGNMENT - 1) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT);
+  image.append(pool);
+  return true;
+}
+
+bool writeCompiledConfig(const ConfigTable &table, const vector<fileStamp> &stamps, const string &filename) {
+  vector<pair<string_view, configValue>> values(table.values.begin(), table.values.end());
+  string image;
+  if (!compileValues(values, table.sources, stamps, image))
+    return false;
+
+  string tempFilename = filename + ".tmp." + to_string(getpid());
+  FILE *out = fopen(tempFilename.c_str(), "wb");
+  if (out == NULL)
+    return false;
+  bool ok = fwrite(image.data(), 1, image.size(), out) == image.size();
+  ok &= fclose(out) == 0;
+  if (!ok || rename(tempFilename.c_str(), filename.c_str()) != 0) {
+    unlink(tempFilename.c_str());
+    return false;
+  }
+  return true;
+}
+
+/** \brief The sections of a compiled image, checked to fit in it.  */
+struct compiledSections {
+  compiledHeader header;
+  const compiledSource *sources;
+  const compiledEntry *entries;
+  const uint32_t *displacements;
+  const uint32_t *order;
+  string_view pool;
+};
+
+/**
+ * \brief Checks that the layout of an image matches and its sections fit in it
+ * \return false if the image is invalid
+ */
+static bool findSections(string_view contents, compiledSections &sections) {
+  compiledHeader &header = sections.header;
+  if (contents.size() < sizeof(header))
+    return false;
+  memcpy(&header, contents.data(), sizeof(header));
+  if (memcmp(header.magic, COMPILED_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != COMPILED_VERSION || header.entrySize != sizeof(compiledEntry) ||
+      header.numSources == 0 || (header.numBuckets == 0) != (header.numEntries == 0))
+    return false;
+  // None of these can overflow, since the counts are 32 bits
+  uint64_t sourcesOffset = sizeof(header);
+  uint64_t entriesOffset = sourcesOffset + (uint64_t)header.numSources * sizeof(compiledSource);
+  uint64_t displacementsOffset = entriesOffset + (uint64_t)header.numEntries * sizeof(compiledEntry);
+  uint64_t orderOffset = displacementsOffset + (uint64_t)header.numBuckets * sizeof(uint32_t);
+  uint64_t stringsOffset = orderOffset + (uint64_t)header.numEntries * sizeof(uint32_t);
+  stringsOffset = (stringsOffset + ARRAY_ALIGNMENT - 1) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT;
+  if (stringsOffset > contents.size() || header.stringsSize != contents.size() - stringsOffset)
+    return false;
+  sections.sources = (const compiledSource *)(contents.data() + sourcesOffset);
+  sections.entries = (const compiledEntry *)(contents.data() + entriesOffset);
+  sections.displacements = (const uint32_t *)(contents.data() + displacementsOffset);
+  sections.order = (const uint32_t *)(contents.data() + orderOffset);
+  sections.pool = contents.substr(stringsOffset);
+  return true;
+}
+
+/**
+ * \brief Gets a range of the string pool
+ * \return false if it does not fit in the pool
+ */
+static bool poolString(string_view pool, uint64_t offset, uint64_t length, string_view &result) {
+  // Checked without adding them, since both are read from the image
+  if (offset > pool.size() || length > pool.size() - offset)
+    return false;
+  result = pool.substr(offset, length);
+  return true;
+}
+
+/**
+ * \brief Reads the sources of an image
+ * \param names Set to the names of the sources
+ * \param stamps If not NULL, set to the versions of the sources
+ * \return false if a name does not fit in the pool
+ */
+static bool readSources(const compiledSections &sections, vector<string> &names, vector<fileStamp> *stamps) {
+  for (uint32_t i = 0; i < sections.header.numSources; i++) {
+    const compiledSource &source = sections.sources[i];
+    string_view name;
+    if (!poolString(sections.pool, source.name.offset, source.name.length, name))
+      return false;
+    names.emplace_back(name);
+    if (stamps == NULL)
+      continue;
+
+    // Sources without a version are never up to date
+    fileStamp stamp;
+    memset(&stamp, 0, sizeof(stamp));
+    stamp.exists = source.stamped == 1;
+    stamp.device = source.device;
+    stamp.inode = source.inode;
+    stamp.size = source.size;
+    stamp.modified.tv_sec = source.modifiedSec;
+    stamp.modified.tv_nsec = source.modifiedNsec;
+    stamps->push_back(stamp);
+  }
+  return true;
+}
+
+/**
+ * \brief Decodes an entry of an image
+ * \param arena Holds the elements of string arrays
+ * \param name Set to the name, which points into the pool
+ * \param value Set to the value, which points into the pool
+ * \return false if the entry is invalid
+ */
+static bool readEntry(const compiledEntry &entry, string_view pool, configArena &arena,
+                      string_view &name, configValue &value) {
+  if (!poolString(pool, entry.name.offset, entry.name.length, name) || entry.type > CONFIG_STRING_ARRAY)
+    return false;
+  value.type = (configType)entry.type;
+  value.unresolved = (entry.flags & COMPILED_UNRESOLVED) != 0;
+  value.unparsed = false;
+  value.length = entry.length;
+  if (value.type == CONFIG_STRING) {
+    string_view str;
+    if (!poolString(pool, entry.payload, entry.length, str))
+      return false;
+    value.stringVal = str.data();
+  }
+  else if (value.type == CONFIG_STRING_ARRAY) {
+    string_view table;
+    if (!poolString(pool, entry.payload, (uint64_t)entry.length * sizeof(compiledString), table) ||
+        (uintptr_t)table.data() % alignof(compiledString) != 0)
+      return false;
+    const compiledString *strings = (const compiledString *)table.data();
+    string_view *elements = (string_view *)arena.allocate(
+      max<size_t>(entry.length, 1) * sizeof(string_view), alignof(string_view));
+    for (uint32_t j = 0; j < entry.length; j++) {
+      new (&elements[j]) string_view();
+      if (!poolString(pool, strings[j].offset, strings[j].length, elements[j]))
+        return false;
+    }
+    value.arrayVal = elements;
+  }
+  else if (elementSize(value.type) != 0) {
+    // Numeric arrays are used in place
+    string_view data;
+    if (!poolString(pool, entry.payload, (uint64_t)entry.length * elementSize(value.type), data) ||
+        (uintptr_t)data.data() % ARRAY_ALIGNMENT != 0)
+      return false;
+    value.arrayVal = data.data();
+  }
+  else memcpy(&value.intVal, &entry.payload, sizeof(entry.payload));
+  return true;
+}
+
+bool readCompiledConfig(shared_ptr<const mappedFile> input, ConfigTable &table, vector<fileStamp> *stamps) {
+  compiledSections sections;
+  if (!findSections(input->contents(), sections))
+    return false;
+
+  ConfigTable result(1);
+  vector<fileStamp> sourceStamps;
+  if (!readSources(sections, result.sources, &sourceStamps))
+    return false;
+  result.values.reserve(sections.header.numEntries);
+  for (uint32_t i = 0; i < sections.header.numEntries; i++) {
+    string_view name;
+    configValue value = {};
+    if (!readEntry(sections.entries[i], sections.pool, *result.arena, name, value))
+      return false;
+    result.values.emplace(name, value);
+  }
+  result.storage.push_back(input);
+  table = std::move(result);
+  if (stamps != NULL)
+    *stamps = std::move(sourceStamps);
+  return true;
+}
+
+bool loadCompiledConfig(const string &filename, const string &source, ConfigTable &table,
+                        vector<fileStamp> *stamps) {
+  shared_ptr<const mappedFile> input = mappedFile::open(filename);
+  ConfigTable result;
+  vector<fileStamp> sourceStamps;
+  if (input == NULL || !readCompiledConfig(input, result, &sourceStamps))
+    return false;
+
+  // Check that it was compiled from this file, and that every source is still
+  // the version it was compiled from.  Comparing the versions exactly, rather
+  // than the times of the sources and the compiled file, also catches edits
+  // made within the same clock tick as the compile.  
+  if (result.sources[0] != source)
+    return false;
+  for (size_t i = 0; i < result.sources.size(); i++) {
+    if (!sourceStamps[i].exists || !(fileStamp::of(result.sources[i]) == sourceStamps[i]))
+      return false;
+  }
+  table = std::move(result);
+  if (stamps != NULL)
+    *stamps = std::move(sourceStamps);
+  return true;
+}
+
+unique_ptr<const compiledImage> compiledImage::open(shared_ptr<const mappedFile> input) {
+  compiledSections sections;
+  unique_ptr<compiledImage> result(new compiledImage());
+  if (!findSections(input->contents(), sections) || !readSources(sections, result->sourceNames, NULL))
+    return NULL;
+  result->input = input;
+  result->hashSeed = sections.header.hashSeed;
+  result->numEntries = sections.header.numEntries;
+  result->buckets = sections.header.numBuckets;
+  result->entries = sections.entries;
+  result->displacementTable = sections.displacements;
+  result->order = sections.order;
+  result->pool = sections.pool;
+  // Zeroed by calloc, so that the pages of slots that are never read are not
+  // touched either
+  result->decoded = (atomic<const frozenTable::entry *> *)calloc(max<size_t>(result->numEntries, 1),
+                                                                 sizeof(atomic<const frozenTable::entry *>));
+  if (result->decoded == NULL)
+    return NULL;
+  return unique_ptr<const compiledImage>(result.release());
+}
+
+compiledImage::~compiledImage() {
+  free(decoded);
+}
+
+const frozenTable::entry *compiledImage::find(size_t slot, uint64_t hash, string_view name) const {
+  // Most misses differ in the hash, and are found without decoding the entry
+  string_view stored;
+  if (slot >= numEntries || entries[slot].hash != hash ||
+      !poolString(pool, entries[slot].name.offset, entries[slot].name.length, stored) || stored != name)
+    return NULL;
+  return at(slot);
+}
+
+const frozenTable::entry *compiledImage::at(size_t slot) const {
+  if (slot >= numEntries)
+    return NULL;
+  const frozenTable::entry *result = decoded[slot].load(memory_order_acquire);
+  if (result != NULL)
+    return result;
+
+  lock_guard<mutex> lock(decodeMutex);
+  result = decoded[slot].load(memory_order_relaxed);
+  if (result != NULL)
+    return result;
+  string_view name;
+  configValue value = {};
+  if (!readEntry(entries[slot], pool, arena, name, value))
+    return NULL;
+  frozenTable::entry *e = (frozenTable::entry *)arena.allocate(sizeof(frozenTable::entry),
+                                                                alignof(frozenTable::entry));
+  new (e) frozenTable::entry{entries[slot].hash, name, value};
+  decoded[slot].store(e, memory_order_release);
+  return e;
+}
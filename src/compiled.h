@@ -0,0 +1,166 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  compiled.h
+ * \brief Binary form of a loaded configuration, for fast startup.  
+ * \details A compiled file holds the values of a configuration file with its
+ * includes merged and its values type checked, along with the list of files
+ * it was read from and the version of each that was read.  Strings are stored
+ * as written, since $ references are expanded after command line overrides
+ * are applied.  It is mapped and used in place: names and strings are views
+ * into the mapping.  The entries are stored in the slots of a frozenTable
+ * along with its displacements and the order of the names, so that an image
+ * can also be read in place without building a table (see compiledImage).  
+ * The layout is native byte order, so compiled files are only valid on the
+ * kind of machine that wrote them.  
+ */
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "configuration.h"
+#include "arena.h"
+#include "frozen_table.h"
+
+class mappedFile;
+struct fileStamp;
+struct compiledEntry;
+
+/** The suffix added to a configuration file name to get its compiled file.  */
+#define COMPILED_CONFIG_SUFFIX ".bin"
+
+/**
+ * \brief Builds the compiled form of a set of values
+ * \param values The values, by name
+ * \param sources The files the values were read from, starting with the
+ * configuration file
+ * \param stamps The versions of the sources that were read, or an empty list
+ * for an image that is never checked against its sources
+ * \param image Set to the compiled form
+ * \return false if the values are too large
+ */
+bool compileValues(const std::vector<std::pair<std::string_view, configValue>> &values,
+                   const std::vector<std::string> &sources, const std::vector<fileStamp> &stamps,
+                   std::string &image);
+
+/**
+ * \brief Writes a table to a compiled file
+ * \details The file is written to a temporary name and renamed into place, so
+ * readers never see a partial file.  
+ * \param table The table, which should have been loaded from files
+ * \param stamps The versions of the files in table.sources that were read
+ * \param filename The file to write
+ * \return false if the file could not be written
+ */
+bool writeCompiledConfig(const ConfigTable &table, const std::vector<fileStamp> &stamps,
+                         const std::string &filename);
+
+/**
+ * \brief Loads a compiled file, if it is up to date
+ * \param filename The compiled file
+ * \param source The configuration file it should have been compiled from
+ * \param table Set to the values if the file is loaded
+ * \param stamps If not NULL, set to the versions of table.sources the file was
+ * compiled from, which are those on disk when it is loaded
+ * \return false if the file is missing, invalid, compiled from a different
+ * file, or any of the files it was compiled from changed since
+ */
+bool loadCompiledConfig(const std::string &filename, const std::string &source, ConfigTable &table,
+                        std::vector<fileStamp> *stamps = NULL);
+
+/**
+ * \brief Reads the compiled form of a configuration, without checking if it
+ * is up to date
+ * \param input The compiled form, kept alive by the table
+ * \param table Set to the values and sources if the compiled form is valid
+ * \param stamps If not NULL, set to the versions of the sources it was
+ * compiled from, with exists false for sources without one
+ * \return false if the compiled form is invalid
+ */
+bool readCompiledConfig(std::shared_ptr<const mappedFile> input, ConfigTable &table,
+                        std::vector<fileStamp> *stamps = NULL);
+
+/**
+ * \brief A compiled image whose values are looked up in place.  
+ * \details Opening an image only checks its header and reads its sources, so
+ * it takes the same time however many values it holds, and the pages of the
+ * image stay shared with every other process that maps it.  Lookups use the
+ * perfect hash stored in the image, comparing the stored hash and name before
+ * reading anything else.  An entry is checked and decoded into a configValue
+ * the first time it is read, and kept for later reads, so a process only pays
+ * for the values it reads.  
+ */
+class compiledImage {
+ public:
+  /**
+   * \brief Checks the layout of an image, without reading its entries
+   * \param input The image, kept alive by the result
+   * \return The image, or NULL if it is invalid
+   */
+  static std::unique_ptr<const compiledImage> open(std::shared_ptr<const mappedFile> input);
+
+  ~compiledImage();
+
+  compiledImage(const compiledImage &) = delete;
+  compiledImage &operator=(const compiledImage &) = delete;
+
+  /** \brief Gets the files the values were read from */
+  const std::vector<std::string> &sources() const { return sourceNames; }
+
+  /** \brief Gets the number of entries */
+  size_t size() const { return numEntries; }
+
+  /** \brief Gets the seed of the hash function the entries were placed with */
+  uint64_t seed() const { return hashSeed; }
+
+  /** \brief Gets the number of buckets of the perfect hash */
+  size_t numBuckets() const { return buckets; }
+
+  /** \brief Gets the displacement of each bucket */
+  const uint32_t *displacements() const { return displacementTable; }
+
+  /**
+   * \brief Gets the entry in a slot, if it has the given name
+   * \param slot The slot the name hashes to
+   * \param hash The hash of the name
+   * \param name The name
+   * \return The entry, or NULL if the slot holds another name or is corrupt
+   */
+  const frozenTable::entry *find(size_t slot, uint64_t hash, std::string_view name) const;
+
+  /**
+   * \brief Gets the entry in a slot
+   * \return The entry, or NULL if the slot is out of range or corrupt
+   */
+  const frozenTable::entry *at(size_t slot) const;
+
+  /** \brief Gets the slots of the entries, in order of name */
+  configArray<uint32_t> sortedOrder() const { return configArray<uint32_t>(order, numEntries); }
+
+ private:
+  compiledImage() : hashSeed(0), numEntries(0), buckets(0), entries(NULL), displacementTable(NULL),
+                    order(NULL), decoded(NULL), arena(4096) {}
+
+  std::shared_ptr<const mappedFile> input;
+  uint64_t hashSeed;
+  size_t numEntries;
+  size_t buckets;
+  const compiledEntry *entries;
+  const uint32_t *displacementTable;
+  const uint32_t *order;
+  std::string_view pool;
+  std::vector<std::string> sourceNames;
+
+  /** The decoded entry of each slot, or NULL until it is first read.  */
+  std::atomic<const frozenTable::entry *> *decoded;
+
+  /** Guards decoding entries into arena.  */
+  mutable std::mutex decodeMutex;
+  mutable configArena arena;
+};
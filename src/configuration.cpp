@@ -6,328 +6,1150 @@
  * \details See config.h for more information.  
  */
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <string>
+#include <string_view>
 #include <string.h>
-#include <boost/regex.hpp>
-#include <boost/algorithm/string.hpp>
-#include <boost/algorithm/string/regex.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <stdlib.h>
 using namespace std;
-using namespace boost;
 
 #include "configuration.h"
-
-/**
- * \brief A type alias for an unordered map containing strings mapped to configValues.  
- */
-typedef unordered_map<string, configValue> ConfigTable;
+#include "arena.h"
+#include "compiled.h"
+#include "dump.h"
+#include "frozen_table.h"
+#include "loader.h"
+#include "mapped_file.h"
+#include "overrides.h"
+#include "read_cache.h"
+#include "scanner.h"
+#include "shared.h"
+#include "stats.h"
+#include "watcher.h"
 
 //Initially set m_instance to NULL
-Configuration *Configuration::m_instance = NULL;
+shared_ptr<Configuration> Configuration::m_instance;
 string Configuration::configFile;
-ConfigTable Configuration::userDefs;
+atomic<unsigned long> Configuration::generation(1);
+
+/** Serializes creating and replacing the instance; never taken by readers.  */
+static mutex instanceMutex;
+
+/** The configuration last read by this thread, kept alive until it moves on.  */
+static thread_local shared_ptr<Configuration> localInstance;
+
+// The files of the last load, and whether the command line changed since it,
+// guarded by instanceMutex
+static parseCache loadedFiles;
+static bool settingsChanged = true;
+
+/** If the configuration was loaded by loadStream, and has no files to reload.  */
+static bool streamLoaded = false;
+
+/** The values set on the command line, also guarded by instanceMutex.  */
+static configOverlay overrides;
+
+/** Set by setLazyParsing, and also guarded by instanceMutex.  */
+static bool lazyParsing = false;
+
+/** Set by setInPlaceEdits, and also guarded by instanceMutex.  */
+static bool inPlaceEdits = false;
+
+// The shared configurations published to and read from, also guarded by
+// instanceMutex.  The segment is attached on the first load from it.  
+static string publishedName;
+static string sharedName;
+static unique_ptr<sharedSegment> attachedSegment;
+static uint64_t sharedGeneration = 0;
+
+/** Set by setReadCache.  */
+static atomic<bool> readCacheEnabled(false);
+static thread_local readCache localReadCache;
+
+/** The last snapshot number given out, where 0 marks empty cache entries.  */
+static atomic<unsigned long> lastSnapshot(0);
+
+struct subscription {
+  unsigned id;
+  string name;
+  function<void()> callback;
+  /** Set instead of the name and callback by subscribeChanges.  */
+  function<void(const Configuration::Diff &)> changes;
+};
+
+static mutex subscriptionMutex;
+static vector<subscription> subscriptions;
+static unsigned lastSubscription = 0;
 
 /**
- * \brief A helper function for loadConfig that tests if the line is valid input.  
+ * \brief A key declared with CONFIG_KEY.  
  */
-bool isAllWhitespace(const string &line);
-
-configValue parseValue(const string &type, const string &valueText) {
-  const char *cValueText = valueText.c_str();
-
-  // Parse the value
-  istringstream iss(valueText);
-  configValue value;
-  value.type = type;
-
-  bool formatError = false;
-  bool used_iss = false;
-  if (type == "int") {
-    iss >> value.intVal;
-    used_iss = true;
-  }
-  else if (type == "hex") {
-    iss >> hex >> value.intVal;
-    used_iss = true;
-    value.type = "int";
-  }
-  else if (type == "octal") {
-    iss >> oct >> value.intVal;
-    used_iss = true;
-    value.type = "int";
-  }
-  else if (type == "float") {
-    iss >> value.floatVal;
-    used_iss = true;
-  }
-  else if (type == "bool" || type == "boolean") {
-    if (valueText == "true" || valueText == "1")
-      value.boolVal = true;
-    else if (valueText == "false" || valueText == "0")
-      value.boolVal = false;
-    else formatError = true;
-    value.type = "bool";
-  }
-  else if (type == "char") {
-    if (sscanf(cValueText, "'%c'", &value.charVal) < 1 &&
-        sscanf(cValueText, "%c", &value.charVal) < 1)
-      formatError = true;
-  }
-  else if (type == "string") {
-    value.stringVal = new char[strlen(cValueText) + 1]; // TODO: Make sure this gets freed in where used when it is no longer needed!  
-    if (sscanf(cValueText, "\"%[^\"]\"", (char *)value.stringVal) < 1 &&
-        sscanf(cValueText, "%[^\"]", (char *)value.stringVal) < 1)
-      formatError = true;
-  }
-  else {
-    value.type = "invalid type name";
-    return value;
-  }
+struct schemaKey {
+  const char *name;
+  configValue defaultValue;
+};
 
-  // Check for syntax errors
-  if ((used_iss && (!iss.eof() || iss.fail())) || formatError) {
-    value.type = "invalid syntax";
-    return value;
-  }
+/** Guards the schema, since keys may be registered while loading.  */
+static mutex schemaMutex;
 
-  return value;
+/** The declared keys, by slot.  */
+static vector<schemaKey> &schema() {
+  static vector<schemaKey> keys;
+  return keys;
 }
 
-ConfigTable mergeConfigTables(ConfigTable c1, ConfigTable c2) {
-  for (ConfigTable::iterator it = c2.begin(); it != c2.end(); it++) {
-    c1[it->first] = it->second;
-  }
-  return c1;
-}
-
-// This is a helper function
-ConfigTable loadConfig(const string &filename) {
-  ifstream input(filename);
-  ConfigTable result;
-
-  // Check if the file can be opened
-  if (input.is_open()) {
-    string line;
-
-    // Iterate over all lines and update the line number
-    for (int lineNum = 1; getline(input, line); lineNum++) {
-      if (!isAllWhitespace(line)) {
-        // Check if the line is an include
-        regex includeParse("use \"(.*)\"");
-        smatch parseResult; // parseResult[0] is the whole string
-        if (regex_match(line, parseResult, includeParse)) {
-          regex filenameParse("/[^/]*$");
-          string newFilename = replace_regex_copy(filename, filenameParse, "/" + parseResult[1]);
-          ConfigTable t = loadConfig(newFilename);
-        
-          //result.insert(t.begin(), t.end()); //Doesn't overwrite
-          for (ConfigTable::iterator it = t.begin(); it != t.end(); it++) {
-            if (result.find(it->first) != result.end()) {
-              cerr << "Warning when parsing include of configuration file " << newFilename <<
-                ": Configuration variable " << it->first << " is already bound" << endl;
-            }
-            result[it->first] = it->second;
-          }
-        }
-        else {
-          // Parse line into type, name, and value.  
-          regex lineParse("([A-Za-z][A-Za-z0-9_-]*) +([A-Za-z][A-Za-z0-9_-]*) *= *((?:[^\n# ]|\".*\")*) *(?:#.*)?");
-          if (!regex_match(line, parseResult, lineParse)) {
-            cerr << "Syntax error when parsing configuration file " << filename << " at line " << lineNum <<
-              ": Unexpected end of line" << endl;
-            exit(1);
-          }
-          string type(parseResult[1]);
-          string name(parseResult[2]);
-          string valueText(parseResult[3]);
-          trim_left(valueText);
-
-          // Parse the value and check for errors
-          configValue value = parseValue(type, valueText);
-          if (value.type == "invalid type name") {
-            cerr << "Syntax error when parsing configuration file " << filename << " at line " << lineNum <<
-              ": Invalid type name " << type << endl;
-            exit(1);
-          }
-          else if (value.type == "invalid syntax") {
-            cerr << "Syntax error when parsing configuration file " << filename << " at line " << lineNum <<
-              ": Invalid value format" << endl;
-            exit(1);
-          }
-
-          // Add the value to the result table.  
-          if (result.find(name) != result.end()) {
-            cerr << "Warning when parsing configuration file " << filename << " at line " << lineNum <<
-              ": Configuration variable " << name << " is already bound" << endl;
-          }
-          value.type =
-            type == "hex" || type == "octal"? "int" :
-            type == "boolean"? "bool" :
-            type;
-          result[name] = value;
-        }
-      }
-    }
-    input.close();
+// Declared last, so that the watcher thread is stopped before the state it
+// refreshes is destroyed
+static once_flag watcherCleanup;
+static mutex watcherMutex;
+static unique_ptr<fileWatcher> watcher;
+
+ConfigTable::ConfigTable(size_t arenaSize) : arena(make_shared<configArena>(arenaSize)) {}
+
+void ConfigTable::keepStorage(const ConfigTable &other) {
+  storage.push_back(other.arena);
+  storage.insert(storage.end(), other.storage.begin(), other.storage.end());
+  sources.insert(sources.end(), other.sources.begin(), other.sources.end());
+}
+
+const char *configTypeName(configType type) {
+  switch (type) {
+  case CONFIG_INT: return "int";
+  case CONFIG_FLOAT: return "float";
+  case CONFIG_CHAR: return "char";
+  case CONFIG_BOOL: return "bool";
+  case CONFIG_STRING: return "string";
+  case CONFIG_LONG: return "long";
+  case CONFIG_DOUBLE: return "double";
+  case CONFIG_INT_ARRAY: return "int[]";
+  case CONFIG_LONG_ARRAY: return "long[]";
+  case CONFIG_FLOAT_ARRAY: return "float[]";
+  case CONFIG_DOUBLE_ARRAY: return "double[]";
+  case CONFIG_STRING_ARRAY: return "string[]";
   }
-  else {
-    cerr << "Could not find configuration file " << filename << endl;
-    exit(1);
+  return "unknown";
+}
+
+string configError::message() const {
+  switch (kind) {
+  case CONFIG_ERROR_MISSING_FILE:
+    return "Could not find configuration file " + source;
+  case CONFIG_ERROR_SYNTAX:
+    return "Syntax error when parsing configuration file " + source + " at line " + to_string(line) +
+      ": " + description;
+  case CONFIG_ERROR_ARGUMENT:
+    return "Syntax error when parsing user-set configuration variable " + source + ": " + description;
+  case CONFIG_ERROR_TYPE_MISMATCH:
+    return "Incompatable type for configuration variable " + source + ": " + description;
+  case CONFIG_ERROR_MISSING_VALUE:
+    return "Could not find configuration variable " + source;
+  case CONFIG_ERROR_UNRESOLVED:
+    return "Could not expand configuration string " + description;
+  case CONFIG_ERROR_READ:
+    return "Could not read configuration " + source;
+  case CONFIG_ERROR_INCLUDE_CYCLE:
+    return "Include cycle when parsing configuration file " + source + " at line " + to_string(line) +
+      ": " + description;
+  case CONFIG_ERROR_SHARED_SEGMENT:
+    return "Could not " + description + " shared configuration " + source;
   }
-  return result;
+  return description;
+}
+
+void Configuration::exitOnErrors(const vector<configError> &errors) {
+  if (errors.empty())
+    return;
+  for (const configError &error : errors)
+    cerr << error.message() << endl;
+  exit(1);
 }
 
 void Configuration::initConfig(int argc, char *argv[], const string &defaultFilename) {
-  configFile = defaultFilename;
-  for (int i = 1; i < argc; i++) {
-    if (strcmp(argv[i], "--use-config") == 0 && i < argc - 1) {
-      configFile = argv[i + 1];
-      i++;
+  exitOnErrors(tryInitConfig(argc, argv, defaultFilename));
+}
+
+/** How deeply argument files may include other argument files.  */
+static const unsigned MAX_ARGUMENT_FILE_DEPTH = 16;
+
+/**
+ * \brief Reads the settings in command line arguments into the overrides
+ * \param args The arguments
+ * \param filename Set to the file given by --use-config, if any
+ * \param errors The errors found are added to this
+ * \param depth The number of argument files being read
+ */
+static void readArguments(argumentReader &args, string &filename, vector<configError> &errors,
+                          unsigned depth) {
+  string arg;
+  while (args.next(arg)) {
+    if (arg == "--use-config") {
+      args.next(filename);
     }
-    else if (strcmp(argv[i], "--add-config") == 0 && i < argc - 1) {
-      userDefs = mergeConfigTables(loadConfig(argv[i + 1]), userDefs);
-      i++;
+    else if (arg == "--add-config") {
+      // Values set earlier on the command line take precedence
+      string added;
+      ConfigTable layer;
+      if (args.next(added) && loadConfig(added, layer, errors))
+        overrides.addLayer(std::move(layer));
     }
-    else if (strncmp(argv[i], "-D", 2) == 0) {
-      string name(argv[i] + 2);
-      if (i == argc - 1) {
-        cerr << "Syntax error when parsing user-set configuration variable " << name <<
-          ": Missing type" << endl;
-        exit(1);
+    else if (arg.size() > 1 && arg[0] == '@') {
+      string argsFilename = arg.substr(1);
+      if (depth >= MAX_ARGUMENT_FILE_DEPTH) {
+        errors.push_back(configError{CONFIG_ERROR_ARGUMENT, arg, 0,
+              "Argument files nested more than " + to_string(MAX_ARGUMENT_FILE_DEPTH) + " deep"});
+        continue;
       }
-      else if (i == argc - 2) {
-        cerr << "Syntax error when parsing user-set configuration variable " << name <<
-          ": Missing type or value" << endl;
-        exit(1);
+      shared_ptr<const mappedFile> file = mappedFile::open(argsFilename);
+      if (file == NULL) {
+        errors.push_back(configError{CONFIG_ERROR_MISSING_FILE, argsFilename, 0, ""});
+        continue;
       }
-      string type(argv[i + 1]);
-      string value(argv[i + 2]);
-      configValue v = parseValue(type, value);
-      if (v.type == "invalid type name") {
-        cerr << "Syntax error when parsing user-set configuration variable " << name <<
-          ": Invalid type name " << type << endl;
-        exit(1);
+      argumentReader fileArgs(file);
+      readArguments(fileArgs, filename, errors, depth + 1);
+    }
+    else if (arg.compare(0, 2, "-D") == 0) {
+      string name = arg.substr(2);
+      string type, valueText;
+      if (!args.next(type)) {
+        errors.push_back(configError{CONFIG_ERROR_ARGUMENT, name, 0, "Missing type"});
+        break;
       }
-      else if (v.type == "invalid syntax") {
-        cerr << "Syntax error when parsing user-set configuration variable " << name <<
-          ": Invalid value format" << endl;
-        exit(1);
+      else if (!args.next(valueText)) {
+        errors.push_back(configError{CONFIG_ERROR_ARGUMENT, name, 0, "Missing type or value"});
+        break;
+      }
+      // String values point into the text, so keep a copy with the table
+      ConfigTable &defines = overrides.defines();
+      string_view value = defines.arena->copy(valueText);
+      configValue v = {};
+      parseStatus status = parseValue(type, value, v, *defines.arena);
+      if (status == PARSE_INVALID_TYPE_NAME) {
+        errors.push_back(configError{CONFIG_ERROR_ARGUMENT, name, 0, "Invalid type name " + type});
+        continue;
       }
-      userDefs[name] = v;
-      i += 2;
+      else if (status == PARSE_INVALID_SYNTAX) {
+        errors.push_back(configError{CONFIG_ERROR_ARGUMENT, name, 0, "Invalid value format"});
+        continue;
+      }
+      auto it = defines.values.find(name);
+      if (it != defines.values.end())
+        it->second = v;
+      else defines.values.emplace(defines.arena->copy(name), v);
     }
   }
 }
 
+vector<configError> Configuration::tryInitConfig(int argc, char *argv[], const string &defaultFilename) {
+  vector<configError> errors;
+  // The watcher reads the settings and overrides while refreshing
+  lock_guard<mutex> lock(instanceMutex);
+  settingsChanged = true;
+  configFile = defaultFilename;
+  argumentReader args(argc, argv);
+  readArguments(args, configFile, errors, 0);
+  return errors;
+}
+
 void Configuration::initConfig(const string &filename) {
+  lock_guard<mutex> lock(instanceMutex);
+  settingsChanged = true;
   configFile = filename;
 }
 
+bool Configuration::compileConfig(const string &filename, const string &compiledFilename) {
+  ConfigTable table;
+  parseCache files;
+  vector<configError> errors;
+  loadConfig(filename, files, table, errors);
+  exitOnErrors(errors);
+
+  // Record the versions that were parsed, so that later edits make it stale
+  vector<fileStamp> stamps;
+  for (const string &source : table.sources) {
+    const fileStamp *stamp = files.stampOf(source);
+    stamps.push_back(stamp != NULL? *stamp : fileStamp{});
+  }
+  return writeCompiledConfig(table, stamps,
+                             compiledFilename.empty()? filename + COMPILED_CONFIG_SUFFIX : compiledFilename);
+}
+
+struct Configuration::lazyValues {
+  explicit lazyValues(size_t size) : values(new atomic<const configValue *>[size]()), arena(4096) {}
+
+  /** The parsed values by index in the frozen table, or NULL until parsed.  */
+  unique_ptr<atomic<const configValue *>[]> values;
+
+  /** Guards parsing, and the arena holding the parsed values.  */
+  std::mutex mutex;
+  configArena arena;
+};
+
+Configuration::Configuration() : snapshot(lastSnapshot.fetch_add(1, memory_order_relaxed) + 1) {}
+
+Configuration::~Configuration() {}
+
+void Configuration::attachShared(const string &name) {
+  lock_guard<mutex> lock(instanceMutex);
+  settingsChanged = true;
+  sharedName = name;
+  attachedSegment.reset();
+}
+
+void Configuration::publishShared(const string &name) {
+  exitOnErrors(tryPublishShared(name));
+}
+
+vector<configError> Configuration::tryPublishShared(const string &name) {
+  vector<configError> errors;
+  lock_guard<mutex> lock(instanceMutex);
+  shared_ptr<Configuration> instance = atomic_load(&m_instance);
+  if (instance == NULL) {
+    instance.reset(load(errors));
+    if (instance == NULL)
+      return errors;
+    atomic_store(&m_instance, instance);
+  }
+  if (instance->publish(name, errors))
+    publishedName = name;
+  return errors;
+}
+
+bool Configuration::publish(const string &name, vector<configError> &errors) const {
+  vector<pair<string_view, configValue>> values;
+  values.reserve(frozen->size());
+  size_t numErrors = errors.size();
+  for (size_t i = 0; i < frozen->size(); i++) {
+    const frozenTable::entry *e = frozen->at(i);
+    const configValue *value = e != NULL? parsed(&e->value, &errors) : NULL;
+    if (value != NULL)
+      values.emplace_back(e->name, *value);
+  }
+  if (errors.size() != numErrors)
+    return false;
+  string image;
+  if (!compileValues(values, config.sources, {}, image) || publishSharedImage(name, image) == 0) {
+    errors.push_back(configError{CONFIG_ERROR_SHARED_SEGMENT, name, 0, "publish"});
+    return false;
+  }
+  return true;
+}
+
+void Configuration::setReadCache(bool enabled) {
+  readCacheEnabled.store(enabled, memory_order_relaxed);
+}
+
+configCacheStats Configuration::readCacheStats() {
+  return readCache::totals();
+}
+
+const configValue *Configuration::findName(string_view name) const {
+  if (!readCacheEnabled.load(memory_order_relaxed))
+    return frozen->find(name);
+  const configValue *value = localReadCache.find(snapshot, name);
+  if (value == NULL) {
+    value = frozen->find(name);
+    if (value != NULL)
+      localReadCache.insert(snapshot, name, value);
+  }
+  return value;
+}
+
+void Configuration::setLazyParsing(bool lazy) {
+  lock_guard<mutex> lock(instanceMutex);
+  if (lazy != lazyParsing)
+    settingsChanged = true;
+  lazyParsing = lazy;
+}
+
+void Configuration::setInPlaceEdits(bool inPlace) {
+  lock_guard<mutex> lock(instanceMutex);
+  if (inPlace != inPlaceEdits)
+    settingsChanged = true;
+  inPlaceEdits = inPlace;
+}
+
+const configValue *Configuration::parseLazy(const configValue *value, vector<configError> *errors) const {
+  atomic<const configValue *> &slot = lazy->values[frozen->indexOf(value)];
+  const configValue *result = slot.load(memory_order_acquire);
+  if (result != NULL)
+    return result;
+
+  lock_guard<std::mutex> lock(lazy->mutex);
+  result = slot.load(memory_order_relaxed);
+  if (result != NULL)
+    return result;
+  // String array elements point into the file, like when parsing eagerly
+  const unparsedValue &text = *(const unparsedValue *)value->arrayVal;
+  configValue *parsedValue = (configValue *)lazy->arena.allocate(sizeof(configValue), alignof(configValue));
+  *parsedValue = configValue();
+  if (parseValue(text.type, text.text, *parsedValue, lazy->arena) != PARSE_OK) {
+    // Not cached, since a value with an error is not read again unless the error is ignored
+    if (errors != NULL)
+      errors->push_back(configError{CONFIG_ERROR_SYNTAX, string(text.filename), text.line, "Invalid value format"});
+    return NULL;
+  }
+  slot.store(parsedValue, memory_order_release);
+  return parsedValue;
+}
+
+vector<configError> Configuration::validateAll() const {
+  vector<configError> errors;
+  for (size_t i = 0; i < frozen->size(); i++) {
+    const frozenTable::entry *e = frozen->at(i);
+    if (e != NULL && e->value.unparsed)
+      parseLazy(&e->value, &errors);
+  }
+  // In the order of the files
+  sort(errors.begin(), errors.end(), [](const configError &a, const configError &b) {
+    return a.source != b.source? a.source < b.source : a.line < b.line;
+  });
+  return errors;
+}
+
+Configuration *Configuration::load(vector<configError> &errors) {
+#ifdef CONFIG_STATS
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+#endif
+  unique_ptr<Configuration> result(new Configuration());
+  settingsChanged = false;
+  streamLoaded = false;
+  bool shared = !sharedName.empty();
+  if (shared) {
+    // Already merged and resolved by the publisher, and read in place
+    unique_ptr<const compiledImage> image;
+    if (attachedSegment == NULL)
+      attachedSegment = sharedSegment::attach(sharedName);
+    if (attachedSegment == NULL || !attachedSegment->load(image, sharedGeneration)) {
+      errors.push_back(configError{CONFIG_ERROR_SHARED_SEGMENT, sharedName, 0, "attach to"});
+      return NULL;
+    }
+    result->config.sources = image->sources();
+    result->frozen.reset(new frozenTable(std::move(image)));
+    loadedFiles.clear();
+  }
+  else {
+    // Use the compiled form of the configuration if it is up to date
+    vector<fileStamp> stamps;
+    if (loadCompiledConfig(configFile + COMPILED_CONFIG_SUFFIX, configFile, result->config, &stamps)) {
+      // Refreshes then only reload once a source changes
+      loadedFiles.clear();
+      loadedFiles.addUnparsed(result->config.sources, stamps);
+    }
+    else if (!loadConfig(configFile, loadedFiles, result->config, errors, lazyParsing, inPlaceEdits))
+      return NULL;
+  }
+  if (!result->finishLoad(shared, errors))
+    return NULL;
+#ifdef CONFIG_STATS
+  recordLoad(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+#endif
+  return result.release();
+}
+
+bool Configuration::finishLoad(bool shared, vector<configError> &errors) {
+  // A shared configuration is already frozen
+  if (!shared) {
+    overrides.applyTo(config);
+    resolveStrings();
+
+    // The values are only read from now on
+    frozen.reset(new frozenTable(config.values));
+    unordered_map<string_view, configValue>().swap(config.values);
+  }
+  if (lazyParsing && !shared)
+    lazy.reset(new lazyValues(frozen->size()));
+  return fillSlots(errors);
+}
+
+void Configuration::install(const shared_ptr<Configuration> &instance, vector<configError> &errors) {
+  atomic_store(&m_instance, instance);
+  generation.fetch_add(1, memory_order_release);
+  if (!publishedName.empty())
+    instance->publish(publishedName, errors);
+}
+
+void Configuration::loadStream(const string &name, configChunkReader reader, configIncludeResolver resolver) {
+  exitOnErrors(tryLoadStream(name, std::move(reader), std::move(resolver)));
+}
+
+vector<configError> Configuration::tryLoadStream(const string &name, configChunkReader reader,
+                                                 configIncludeResolver resolver) {
+  vector<configError> errors;
+  shared_ptr<Configuration> previous, instance;
+  {
+    lock_guard<mutex> lock(instanceMutex);
+    unique_ptr<Configuration> result(new Configuration());
+    if (!loadConfigStream(name, reader, resolver, result->config, errors, lazyParsing) ||
+        !result->finishLoad(false, errors))
+      return errors;
+    previous = atomic_load(&m_instance);
+    instance.reset(result.release());
+    settingsChanged = false;
+    streamLoaded = true;
+    loadedFiles.clear();
+    install(instance, errors);
+  }
+  if (previous != NULL)
+    notifySubscribers(*previous, *instance);
+  return errors;
+}
+
 //This gets the global config, and creates it if needed
 Configuration* Configuration::get() {
-  if (m_instance == NULL) {
-    m_instance = new Configuration();
-    m_instance->config = mergeConfigTables(loadConfig(configFile), userDefs);
+  if (localGeneration != generation.load(memory_order_acquire)) {
+    // This thread's snapshot is out of date.  Reading the generation before the
+    // instance means the snapshot is at worst newer than its label, in which
+    // case it is just reloaded on the next call.  
+    unsigned long current = generation.load(memory_order_acquire);
+    shared_ptr<Configuration> instance = atomic_load(&m_instance);
+    if (instance == NULL) {
+      lock_guard<mutex> lock(instanceMutex);
+      instance = atomic_load(&m_instance);
+      if (instance == NULL) {
+        vector<configError> errors;
+        instance.reset(load(errors));
+        exitOnErrors(errors);
+        atomic_store(&m_instance, instance);
+      }
+    }
+    localInstance = instance;
+    localPointer = instance.get();
+    localGeneration = current;
   }
-  return m_instance;
+  return localInstance.get();
 }
 
 void Configuration::refresh() {
-  if (m_instance != NULL)
-    delete m_instance;
-  m_instance = NULL;
+  {
+    // An unloaded configuration is loaded on first use
+    lock_guard<mutex> lock(instanceMutex);
+    if (atomic_load(&m_instance) == NULL)
+      return;
+  }
+  for (const configError &error : tryRefresh())
+    cerr << error.message() << endl;
 }
 
-bool isAllWhitespace(const string &line) {
-  // Ignore comments and empty lines
-  bool allWhitespace = true;
-  for (int i = 0, line_len = line.length(); i < line_len; i++) {
-    if (line[i] == '#') {
-      break;
+vector<configError> Configuration::tryRefresh() {
+  vector<configError> errors;
+  shared_ptr<Configuration> previous, instance;
+  {
+    lock_guard<mutex> lock(instanceMutex);
+    previous = atomic_load(&m_instance);
+    // Keep the current snapshot if none of its files changed, or nothing new
+    // was published
+    bool changed = streamLoaded? false : sharedName.empty()? loadedFiles.changed() :
+      attachedSegment == NULL || attachedSegment->generation() != sharedGeneration;
+    if (previous != NULL && !settingsChanged && !changed)
+      return errors;
+    instance.reset(load(errors));
+    if (instance == NULL)
+      return errors;
+    install(instance, errors);
+  }
+  // Callbacks may read the configuration or refresh it again
+  if (previous != NULL)
+    notifySubscribers(*previous, *instance);
+  return errors;
+}
+
+void Configuration::watch(unsigned delayMs) {
+  // The schema is created on first use, so create it now to stop the watcher
+  // at exit before it is destroyed
+  call_once(watcherCleanup, [] {
+    schema();
+    atexit(unwatch);
+  });
+  lock_guard<mutex> lock(watcherMutex);
+  watcher.reset();
+  bool poll;
+  {
+    lock_guard<mutex> lock(instanceMutex);
+    poll = !sharedName.empty();
+  }
+  // A shared configuration has no files of its own to watch
+  watcher.reset(new fileWatcher(refresh, [] {
+    shared_ptr<Configuration> instance = atomic_load(&m_instance);
+    return instance != NULL? instance->config.sources : vector<string>();
+  }, delayMs, poll));
+}
+
+void Configuration::unwatch() {
+  lock_guard<mutex> lock(watcherMutex);
+  watcher.reset();
+}
+
+unsigned Configuration::subscribe(const string &name, function<void()> callback) {
+  lock_guard<mutex> lock(subscriptionMutex);
+  unsigned id = ++lastSubscription;
+  subscriptions.push_back(subscription{id, name, std::move(callback), nullptr});
+  return id;
+}
+
+unsigned Configuration::subscribeChanges(function<void(const Diff &)> callback) {
+  lock_guard<mutex> lock(subscriptionMutex);
+  unsigned id = ++lastSubscription;
+  subscriptions.push_back(subscription{id, "", nullptr, std::move(callback)});
+  return id;
+}
+
+void Configuration::unsubscribe(unsigned id) {
+  lock_guard<mutex> lock(subscriptionMutex);
+  for (auto it = subscriptions.begin(); it != subscriptions.end(); it++) {
+    if (it->id == id) {
+      subscriptions.erase(it);
+      return;
     }
-    else allWhitespace &= line[i] == ' ';
   }
-  return allWhitespace;
 }
 
-int Configuration::getIntConfig(const string &name) {
-  if (config.find(name) == config.end()) {
-    cerr << "Could not find configuration variable " << name << endl;
-    exit(1);
+void Configuration::notifySubscribers(const Configuration &previous, const Configuration &current) {
+  vector<subscription> changed;
+  {
+    lock_guard<mutex> lock(subscriptionMutex);
+    for (const subscription &s : subscriptions) {
+      if (s.changes || !sameValue(previous, current, s.name))
+        changed.push_back(s);
+    }
   }
-  else if (config[name].type != "int") {
-    cerr << "Incompatable type for configuration variable " << name << ": " <<
-      "Looked for int, but found " << config[name].type << endl;
-    exit(1);
+  // Only computed if someone asked for it
+  unique_ptr<Diff> diff;
+  for (const subscription &s : changed) {
+    if (!s.changes)
+      s.callback();
+    else {
+      if (diff == NULL)
+        diff.reset(new Diff(current.diff(previous)));
+      if (!diff->empty())
+        s.changes(*diff);
+    }
   }
-  else return config[name].intVal;
 }
 
-float Configuration::getFloatConfig(const string &name) {
-  if (config.find(name) == config.end()) {
-    cerr << "Could not find configuration variable " << name << endl;
-    exit(1);
+Configuration::Diff Configuration::diff(const Configuration &previous) const {
+  Diff result(previous, *this);
+  for (size_t i = 0; i < frozen->size(); i++) {
+    const frozenTable::entry *e = frozen->at(i);
+    if (e == NULL)
+      continue;
+    const configValue *old = previous.frozen->find(e->name);
+    if (old == NULL)
+      result.changes.push_back(configChange{CONFIG_ADDED, e->name});
+    else if (!sameValue(previous, old, *this, &e->value))
+      result.changes.push_back(configChange{CONFIG_CHANGED, e->name});
   }
-  else if (config[name].type != "float") {
-    cerr << "Incompatable type for configuration variable " << name << ": " <<
-      "Looked for float, but found " << config[name].type << endl;
-    exit(1);
+  for (size_t i = 0; i < previous.frozen->size(); i++) {
+    const frozenTable::entry *e = previous.frozen->at(i);
+    if (e != NULL && frozen->find(e->name) == NULL)
+      result.changes.push_back(configChange{CONFIG_REMOVED, e->name});
   }
-  else return config[name].floatVal;
+  sort(result.changes.begin(), result.changes.end(), [](const configChange &a, const configChange &b) {
+    return a.name < b.name;
+  });
+  return result;
 }
 
-bool Configuration::getBoolConfig(const string &name) {
-  if (config.find(name) == config.end()) {
+const configChange *Configuration::Diff::find(string_view name) const {
+  auto it = lower_bound(changes.begin(), changes.end(), name, [](const configChange &c, string_view name) {
+    return c.name < name;
+  });
+  return it != changes.end() && it->name == name? &*it : NULL;
+}
+
+template <typename T>
+static bool sameElements(const configValue &x, const configValue &y) {
+  configArray<T> a((const T *)x.arrayVal, x.length), b((const T *)y.arrayVal, y.length);
+  return a.size() == b.size() && equal(a.begin(), a.end(), b.begin());
+}
+
+bool Configuration::sameValue(const Configuration &a, const Configuration &b, const string &name) {
+  const configValue *x = a.frozen->find(name);
+  const configValue *y = b.frozen->find(name);
+  if (x == NULL || y == NULL)
+    return x == y;
+  return sameValue(a, x, b, y);
+}
+
+bool Configuration::sameValue(const Configuration &a, const configValue *x, const Configuration &b,
+                              const configValue *y) {
+  if (x->type != y->type)
+    return false;
+  // Values read from a file that did not change point to the same text, so
+  // they are the same without parsing or comparing it
+  uint64_t xBits, yBits;
+  memcpy(&xBits, &x->intVal, sizeof(xBits));
+  memcpy(&yBits, &y->intVal, sizeof(yBits));
+  if (xBits == yBits && x->length == y->length && x->unparsed == y->unparsed && x->unresolved == y->unresolved)
+    return true;
+  if (x->unparsed || y->unparsed) {
+    const configValue *px = a.parsed(x), *py = b.parsed(y);
+    if (px == NULL || py == NULL) {
+      // Values with errors are the same if their text is
+      return px == py && x->unparsed && y->unparsed &&
+        ((const unparsedValue *)x->arrayVal)->text == ((const unparsedValue *)y->arrayVal)->text;
+    }
+    x = px;
+    y = py;
+  }
+  switch (x->type) {
+  case CONFIG_INT: return x->intVal == y->intVal;
+  case CONFIG_FLOAT: return x->floatVal == y->floatVal;
+  case CONFIG_CHAR: return x->charVal == y->charVal;
+  case CONFIG_BOOL: return x->boolVal == y->boolVal;
+  case CONFIG_LONG: return x->longVal == y->longVal;
+  case CONFIG_DOUBLE: return x->doubleVal == y->doubleVal;
+  case CONFIG_INT_ARRAY: return sameElements<int>(*x, *y);
+  case CONFIG_LONG_ARRAY: return sameElements<long long>(*x, *y);
+  case CONFIG_FLOAT_ARRAY: return sameElements<float>(*x, *y);
+  case CONFIG_DOUBLE_ARRAY: return sameElements<double>(*x, *y);
+  case CONFIG_STRING_ARRAY: return sameElements<string_view>(*x, *y);
+  case CONFIG_STRING:
+    // Unresolved strings hold their text before expansion
+    return x->unresolved == y->unresolved &&
+      string_view(x->stringVal, x->length) == string_view(y->stringVal, y->length);
+  }
+  return false;
+}
+
+unsigned Configuration::registerKey(const char *name, const configValue &defaultValue) {
+  lock_guard<mutex> lock(schemaMutex);
+  vector<schemaKey> &keys = schema();
+  for (unsigned i = 0; i < keys.size(); i++) {
+    if (strcmp(keys[i].name, name) == 0) {
+      if (keys[i].defaultValue.type != defaultValue.type) {
+        cerr << "Configuration key " << name << " is declared as both " <<
+          configTypeName(keys[i].defaultValue.type) << " and " << configTypeName(defaultValue.type) << endl;
+        exit(1);
+      }
+      return i;
+    }
+  }
+  keys.push_back({name, defaultValue});
+  return keys.size() - 1;
+}
+
+bool Configuration::fillSlots(vector<configError> &errors) {
+  lock_guard<mutex> lock(schemaMutex);
+  const vector<schemaKey> &keys = schema();
+  slots.resize(keys.size());
+  bool ok = true;
+  for (size_t i = 0; i < keys.size(); i++) {
+    const configValue *value = frozen->find(keys[i].name);
+    if (value == NULL)
+      slots[i] = keys[i].defaultValue;
+    else if (value->type != keys[i].defaultValue.type) {
+      errors.push_back(configError{CONFIG_ERROR_TYPE_MISMATCH, keys[i].name, 0,
+            string("Looked for ") + configTypeName(keys[i].defaultValue.type) + ", but found " +
+            configTypeName(value->type)});
+      ok = false;
+    }
+    else if ((value = parsed(value, &errors)) == NULL)
+      ok = false;
+    else slots[i] = *value;
+  }
+  return ok;
+}
+
+configValue Configuration::lateSlot(unsigned slot) const {
+  schemaKey key;
+  {
+    lock_guard<mutex> lock(schemaMutex);
+    key = schema()[slot];
+  }
+  const configValue *value = frozen->find(key.name);
+  return value != NULL? lookupValue(key.name, key.defaultValue.type) : key.defaultValue;
+}
+
+const configValue *Configuration::findValue(const string &name, configType type) const {
+  const configValue *value = findName(name);
+  if (value == NULL || value->type != type || value->unresolved)
+    value = NULL;
+  else value = parsed(value);
+#ifdef CONFIG_STATS
+  statsCounter(name, NULL)->add(value == NULL);
+#endif
+  return value;
+}
+
+const configValue &Configuration::lookupValue(const string &name, configType type) const {
+  const configValue *value = findName(name);
+#ifdef CONFIG_STATS
+  statsCounter(name, NULL)->add(value == NULL);
+#endif
+  if (value == NULL) {
     cerr << "Could not find configuration variable " << name << endl;
     exit(1);
   }
-  else if (config[name].type != "bool") {
+  else if (value->type != type) {
     cerr << "Incompatable type for configuration variable " << name << ": " <<
-      "Looked for bool, but found " << config[name].type << endl;
+      "Looked for " << configTypeName(type) << ", but found " << configTypeName(value->type) << endl;
     exit(1);
   }
-  else return config[name].boolVal;
+  else if (value->unparsed) {
+    vector<configError> errors;
+    value = parseLazy(value, &errors);
+    exitOnErrors(errors);
+  }
+  return *value;
+}
+
+int Configuration::getIntConfig(const string &name) {
+  return lookupValue(name, CONFIG_INT).intVal;
+}
+
+float Configuration::getFloatConfig(const string &name) {
+  return lookupValue(name, CONFIG_FLOAT).floatVal;
+}
+
+long long Configuration::getLongConfig(const string &name) {
+  return lookupValue(name, CONFIG_LONG).longVal;
+}
+
+double Configuration::getDoubleConfig(const string &name) {
+  return lookupValue(name, CONFIG_DOUBLE).doubleVal;
+}
+
+bool Configuration::getBoolConfig(const string &name) {
+  return lookupValue(name, CONFIG_BOOL).boolVal;
 }
 
 char Configuration::getCharConfig(const string &name) {
-  if (config.find(name) == config.end()) {
-    cerr << "Could not find configuration variable " << name << endl;
-    exit(1);
+  return lookupValue(name, CONFIG_CHAR).charVal;
+}
+
+configArray<int> Configuration::getIntArray(const string &name) {
+  return configTraits<configArray<int>>::extract(*this, lookupValue(name, CONFIG_INT_ARRAY));
+}
+
+configArray<long long> Configuration::getLongArray(const string &name) {
+  return configTraits<configArray<long long>>::extract(*this, lookupValue(name, CONFIG_LONG_ARRAY));
+}
+
+configArray<float> Configuration::getFloatArray(const string &name) {
+  return configTraits<configArray<float>>::extract(*this, lookupValue(name, CONFIG_FLOAT_ARRAY));
+}
+
+configArray<double> Configuration::getDoubleArray(const string &name) {
+  return configTraits<configArray<double>>::extract(*this, lookupValue(name, CONFIG_DOUBLE_ARRAY));
+}
+
+configArray<string_view> Configuration::getStringArray(const string &name) {
+  return configTraits<configArray<string_view>>::extract(*this, lookupValue(name, CONFIG_STRING_ARRAY));
+}
+
+/**
+ * \brief Finds the next $NAME reference in a string
+ * \param str The string
+ * \param pos The position to start searching from, updated to the position
+ * of the $
+ * \return The name, or an empty view if there are no more references
+ */
+static string_view nextReference(string_view str, size_t &pos) {
+  for (; pos < str.size(); pos++) {
+    if (str[pos] == '$' && pos + 1 < str.size() && isIdentStart(str[pos + 1])) {
+      size_t end = pos + 2;
+      while (end < str.size() && isIdentChar(str[end]))
+        end++;
+      return str.substr(pos + 1, end - pos - 1);
+    }
   }
-  else if (config[name].type != "char") {
-    cerr << "Incompatable type for configuration variable " << name << ": " <<
-      "Looked for char, but found " << config[name].type << endl;
-    exit(1);
+  return string_view();
+}
+
+void Configuration::resolveStrings() {
+  // Each string is expanded once; state is 1 while a name is being expanded
+  // and 2 once it is finished
+  unordered_map<string_view, char> state;
+  for (auto it = config.values.begin(); it != config.values.end(); it++) {
+    if (it->second.type == CONFIG_STRING)
+      resolveString(it->first, it->second, state);
   }
-  else return config[name].charVal;
 }
 
+bool Configuration::resolveString(string_view name, configValue &value,
+                                  unordered_map<string_view, char> &state) {
+  char &current = state[name];
+  if (current == 2)
+    return !value.unresolved;
+  else if (current == 1)
+    return false; // Cyclic reference
+
+  string_view str(value.stringVal, value.length);
+  size_t pos = 0;
+  if (nextReference(str, pos).empty()) {
+    current = 2;
+    return true;
+  }
+
+  current = 1;
+  string result;
+  size_t last = 0;
+  for (string_view ref; !(ref = nextReference(str, pos)).empty(); last = pos) {
+    result.append(str, last, pos - last);
+    pos += ref.size() + 1;
 
-string expandVar(const smatch &match) {
-  string varName(match[1]);
-  return Configuration::get()->getStringConfig(varName);
+    auto it = config.values.find(ref);
+    if (it == config.values.end() || it->second.type != CONFIG_STRING ||
+        !resolveString(it->first, it->second, state)) {
+      // Leave the string as written, and report the error when it is read
+      value.unresolved = true;
+      state[name] = 2;
+      return false;
+    }
+    result.append(it->second.stringVal, it->second.length);
+  }
+  result.append(str, last);
+
+  string_view expanded = config.arena->copy(result);
+  value.stringVal = expanded.data();
+  value.length = expanded.size();
+  state[name] = 2;
+  return true;
+}
+
+string_view Configuration::stringValue(const configValue &value) const {
+  string_view str(value.stringVal, value.length);
+  if (value.unresolved) {
+    vector<string_view> chain;
+    reportUnresolved(str, chain);
+  }
+  return str;
+}
+
+void Configuration::reportUnresolved(string_view str, vector<string_view> &chain) const {
+  // Follow the references of an unresolved string until reaching the error
+  size_t pos = 0;
+  for (string_view ref; !(ref = nextReference(str, pos)).empty(); pos += ref.size() + 1) {
+    for (size_t i = 0; i < chain.size(); i++) {
+      if (chain[i] == ref) {
+        cerr << "Cyclic reference to configuration variable " << ref << ": ";
+        for (size_t j = i; j < chain.size(); j++)
+          cerr << chain[j] << " -> ";
+        cerr << ref << endl;
+        exit(1);
+      }
+    }
+    const configValue &value = lookupValue(string(ref), CONFIG_STRING);
+    if (value.unresolved) {
+      chain.push_back(ref);
+      reportUnresolved(string_view(value.stringVal, value.length), chain);
+    }
+  }
+  cerr << "Could not expand configuration string " << str << endl;
+  exit(1);
 }
 
 string Configuration::getStringConfig(const string &name) {
-  if (config.find(name) == config.end()) {
-    cerr << "Could not find configuration variable " << name << endl;
+  return string(stringValue(lookupValue(name, CONFIG_STRING)));
+}
+
+string_view Configuration::getStringView(const string &name) {
+  return stringValue(lookupValue(name, CONFIG_STRING));
+}
+
+/**
+ * \brief Adds an error if a value is missing, has another type, or is an
+ * unresolved string
+ * \return false if there was an error
+ */
+static bool checkValue(const configValue *value, configType type, const string &name, vector<configError> &errors) {
+  if (value == NULL)
+    errors.push_back(configError{CONFIG_ERROR_MISSING_VALUE, name, 0, ""});
+  else if (value->type != type) {
+    errors.push_back(configError{CONFIG_ERROR_TYPE_MISMATCH, name, 0,
+        string("Looked for ") + configTypeName(type) + ", but found " + configTypeName(value->type)});
+  }
+  else if (value->unresolved)
+    errors.push_back(configError{CONFIG_ERROR_UNRESOLVED, name, 0, string(value->stringVal, value->length)});
+  else return true;
+  return false;
+}
+
+template <typename F>
+vector<configError> Configuration::fillBindings(const Configuration &instance,
+                                                initializer_list<configBinding> bindings,
+                                                F find, const string &prefix) {
+  vector<configError> errors;
+  // Avoid allocating for the usual number of values
+  const configValue *localValues[64];
+  vector<const configValue *> manyValues;
+  const configValue **values = localValues;
+  if (bindings.size() > 64) {
+    manyValues.resize(bindings.size());
+    values = manyValues.data();
+  }
+  size_t count = 0;
+  for (const configBinding &binding : bindings) {
+    const configValue *value = find(string_view(binding.name));
+    if (value == NULL || value->type != binding.type || value->unresolved || value->unparsed)
+      value = instance.checkBinding(value, binding.type, prefix + binding.name, errors);
+    values[count++] = value;
+  }
+  if (errors.empty()) {
+    size_t i = 0;
+    for (const configBinding &binding : bindings)
+      binding.store(instance, *values[i++], binding.destination);
+  }
+  return errors;
+}
+
+const configValue *Configuration::findCounted(string_view name) const {
+  const configValue *value = findName(name);
+#ifdef CONFIG_STATS
+  statsCounter(name, NULL)->add(value == NULL);
+#endif
+  return value;
+}
+
+const configValue *Configuration::checkBinding(const configValue *value, configType type, const string &name,
+                                               vector<configError> &errors) const {
+  return checkValue(value, type, name, errors)? parsed(value, &errors) : NULL;
+}
+
+vector<configError> Configuration::tryFill(initializer_list<configBinding> bindings) const {
+  return fillBindings(*this, bindings, [this](string_view name) { return findCounted(name); }, "");
+}
+
+void Configuration::fill(initializer_list<configBinding> bindings) const {
+  exitOnErrors(tryFill(bindings));
+}
+
+vector<configError> Configuration::View::tryFill(initializer_list<configBinding> bindings) const {
+  return fillBindings(*instance, bindings, [this](string_view name) { return find(name); }, prefix);
+}
+
+void Configuration::View::fill(initializer_list<configBinding> bindings) const {
+  exitOnErrors(tryFill(bindings));
+}
+
+Configuration::View Configuration::scope(string_view prefix) const {
+  View result;
+  result.instance = this;
+  if (!prefix.empty())
+    result.prefix = string(prefix) + '.';
+
+  // The names with the prefix are contiguous in sorted order.  Corrupt entries
+  // of a shared configuration are skipped.  
+  configArray<uint32_t> order = frozen->sortedOrder();
+  auto nameAt = [this](uint32_t i) {
+    const frozenTable::entry *e = frozen->at(i);
+    return e != NULL? e->name : string_view();
+  };
+  auto first = lower_bound(order.begin(), order.end(), result.prefix, [&nameAt](uint32_t i, const string &name) {
+    return nameAt(i) < name;
+  });
+  for (auto it = first; it != order.end(); it++) {
+    const frozenTable::entry *e = frozen->at(*it);
+    if (e == NULL)
+      continue;
+    if (e->name.compare(0, result.prefix.size(), result.prefix) != 0)
+      break;
+    if (e->name.size() > result.prefix.size()) {
+      // Values with errors are left unparsed, to be reported when they are read
+      const configValue *value = parsed(&e->value);
+      result.entries.push_back(View::entry{e->name.substr(result.prefix.size()), value != NULL? value : &e->value});
+    }
+  }
+  return result;
+}
+
+void Configuration::visitSorted(void (*visit)(void *, string_view, const configValue &), void *context) const {
+  for (uint32_t i : frozen->sortedOrder()) {
+    const frozenTable::entry *e = frozen->at(i);
+    if (e == NULL)
+      continue;
+    const configValue *value = parsed(&e->value);
+    visit(context, e->name, value != NULL? *value : e->value);
+  }
+}
+
+bool Configuration::dumpConfig(ostream &out, configDumpFormat format) const {
+  bool ok = true;
+  if (format == CONFIG_DUMP_TEXT) {
+    configTextWriter writer(out);
+    forEach([&](string_view name, const configValue &value) {
+      ok = writer.write(name, value) && ok;
+    });
+  }
+  else {
+    vector<pair<string_view, configValue>> values;
+    values.reserve(frozen->size());
+    forEach([&](string_view name, const configValue &value) {
+      if (value.unparsed)
+        ok = false;
+      else values.emplace_back(name, value);
+    });
+    string image;
+    if (compileValues(values, config.sources, {}, image))
+      out.write(image.data(), image.size());
+    else ok = false;
+  }
+  out.flush();
+  return ok && out.good();
+}
+
+Configuration::View Configuration::View::scope(string_view section) const {
+  View result;
+  result.instance = instance;
+  if (section.empty()) {
+    result.prefix = prefix;
+    result.entries = entries;
+    return result;
+  }
+  // The names in the section are contiguous in sorted order
+  string relative = string(section) + '.';
+  result.prefix = prefix + relative;
+  auto first = lower_bound(entries.begin(), entries.end(), relative, [](const entry &e, const string &name) {
+    return e.name < name;
+  });
+  for (auto it = first; it != entries.end() && it->name.compare(0, relative.size(), relative) == 0; it++) {
+    if (it->name.size() > relative.size())
+      result.entries.push_back(entry{it->name.substr(relative.size()), it->value});
+  }
+  return result;
+}
+
+const configValue *Configuration::View::find(string_view name) const {
+  auto it = lower_bound(entries.begin(), entries.end(), name, [](const entry &e, string_view name) {
+    return e.name < name;
+  });
+  const configValue *value = it != entries.end() && it->name == name? it->value : NULL;
+#ifdef CONFIG_STATS
+  statsCounter(prefix + string(name), NULL)->add(value == NULL);
+#endif
+  return value;
+}
+
+const configValue &Configuration::View::lookupValue(string_view name, configType type) const {
+  const configValue *value = find(name);
+  if (value == NULL) {
+    cerr << "Could not find configuration variable " << prefix << name << endl;
     exit(1);
   }
-  else if (config[name].type != "string") {
-    cerr << "Incompatable type for configuration variable " << name << ": " <<
-      "Looked for string, but found " << config[name].type << endl;
+  else if (value->type != type) {
+    cerr << "Incompatable type for configuration variable " << prefix << name << ": " <<
+      "Looked for " << configTypeName(type) << ", but found " << configTypeName(value->type) << endl;
     exit(1);
   }
-  else {
-    string str(config[name].stringVal);
-    regex varSearch("\\$([A-Za-z][A-Za-z0-9_-]*)");
-    return regex_replace(str, varSearch, expandVar);
+  else if (value->unparsed) {
+    vector<configError> errors;
+    value = instance->parseLazy(value, &errors);
+    exitOnErrors(errors);
   }
+  return *value;
 }
 
 bool Configuration::hasConfig(const string &name) {
-  return config.find(name) != config.end();
+  bool found = findName(name) != NULL;
+#ifdef CONFIG_STATS
+  statsCounter(name, NULL)->add(!found);
+#endif
+  return found;
 }
@@ -0,0 +1,142 @@
+/**
+ * \author Lucas Kramer
+ * \file  dump.cpp
+ * \brief Implementation of writing values as configuration text.  
+ * \details See dump.h for more information.  
+ */
+
+#include <math.h>
+#include <charconv>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+using namespace std;
+
+#include "dump.h"
+#include "loader.h"
+#include "scanner.h"
+
+/**
+ * \brief Appends a number in the shortest form that parses back to it
+ * \return false for infinities and NaNs, which can't be parsed
+ */
+template <typename T>
+static bool appendNumber(string &line, T number) {
+  if constexpr (is_floating_point_v<T>) {
+    if (!isfinite(number))
+      return false;
+  }
+  char buffer[32];
+  to_chars_result r = to_chars(buffer, buffer + sizeof(buffer), number);
+  line.append(buffer, r.ptr - buffer);
+  return true;
+}
+
+/**
+ * \brief Appends the elements of an array, in brackets
+ * \param appendElement Appends one element, returning false if it can't be written
+ */
+template <typename T, typename F>
+static bool appendArray(string &line, const configValue &value, F appendElement) {
+  const T *elements = (const T *)value.arrayVal;
+  line += '[';
+  for (unsigned i = 0; i < value.length; i++) {
+    if (i != 0)
+      line += ", ";
+    if (!appendElement(elements[i]))
+      return false;
+  }
+  line += ']';
+  return true;
+}
+
+bool configTextWriter::write(string_view name, const configValue &value) {
+  size_t dot = name.rfind('.');
+  string_view valueSection = dot == string_view::npos? string_view() : name.substr(0, dot);
+  string_view shortName = dot == string_view::npos? name : name.substr(dot + 1);
+  if (valueSection != section) {
+    // A name that is not a valid section leaves the previous header in place
+    line = "[";
+    line.append(valueSection);
+    line += ']';
+    scannedLine scanned = scanLine(line);
+    if (scanned.kind == LINE_SECTION && scanned.name == valueSection) {
+      line += '\n';
+      out << line;
+      section = string(valueSection);
+    }
+  }
+
+  // Values with syntax errors are written as they were in the file
+  const unparsedValue *text = value.unparsed? (const unparsedValue *)value.arrayVal : NULL;
+  string_view type = text != NULL? text->type : configTypeName(value.type);
+  line.assign(type);
+  line += ' ';
+  line.append(shortName);
+  line += " = ";
+  size_t valueStart = line.size();
+  bool ok = section == valueSection;
+  if (ok && text != NULL)
+    line.append(text->text);
+  else if (ok)
+    ok = appendValue(value);
+  if (ok && scansAs(type, shortName, valueStart)) {
+    line += '\n';
+    out << line;
+    return true;
+  }
+  out << "# " << type << ' ' << name << " cannot be written as a setting\n";
+  return false;
+}
+
+bool configTextWriter::appendValue(const configValue &value) {
+  switch (value.type) {
+  case CONFIG_INT: return appendNumber(line, value.intVal);
+  case CONFIG_LONG: return appendNumber(line, value.longVal);
+  case CONFIG_FLOAT: return appendNumber(line, value.floatVal);
+  case CONFIG_DOUBLE: return appendNumber(line, value.doubleVal);
+  case CONFIG_BOOL:
+    line += value.boolVal? "true" : "false";
+    return true;
+  case CONFIG_CHAR:
+    line += '\'';
+    line += value.charVal;
+    line += '\'';
+    return true;
+  case CONFIG_STRING: {
+    // Strings end at the first quote, and may not be empty
+    string_view str(value.stringVal, value.length);
+    if (str.empty() || str.find('"') != string_view::npos)
+      return false;
+    line += '"';
+    line.append(str);
+    line += '"';
+    return true;
+  }
+  case CONFIG_INT_ARRAY:
+    return appendArray<int>(line, value, [this](int x) { return appendNumber(line, x); });
+  case CONFIG_LONG_ARRAY:
+    return appendArray<long long>(line, value, [this](long long x) { return appendNumber(line, x); });
+  case CONFIG_FLOAT_ARRAY:
+    return appendArray<float>(line, value, [this](float x) { return appendNumber(line, x); });
+  case CONFIG_DOUBLE_ARRAY:
+    return appendArray<double>(line, value, [this](double x) { return appendNumber(line, x); });
+  case CONFIG_STRING_ARRAY:
+    return appendArray<string_view>(line, value, [this](string_view str) {
+      if (str.find('"') != string_view::npos)
+        return false;
+      line += '"';
+      line.append(str);
+      line += '"';
+      return true;
+    });
+  }
+  return false;
+}
+
+bool configTextWriter::scansAs(string_view type, string_view name, size_t valueStart) const {
+  scannedLine scanned = scanLine(line);
+  return scanned.kind == LINE_SETTING && scanned.type == type && scanned.name == name &&
+    scanned.value == string_view(line).substr(valueStart);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  dump.h
+ * \brief Internal interface for writing values back as configuration text.  
+ * \details See Configuration::dumpConfig.  
+ */
+
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+#include "configuration.h"
+
+/**
+ * \brief Writes values as the lines of a configuration file.  
+ * \details Names with sections are written under [section] headers, and every
+ * line is scanned again before it is written, so that only lines that load to
+ * the same value are written as settings.  Values added in order of name
+ * share the headers of their sections.  
+ */
+class configTextWriter {
+ public:
+  explicit configTextWriter(std::ostream &out) : out(out) {}
+
+  /**
+   * \brief Writes a value
+   * \param name The full name of the value
+   * \param value The value, which may be unparsed
+   * \return false if the value cannot be written in the syntax of a file, in
+   * which case a comment naming it is written instead
+   */
+  bool write(std::string_view name, const configValue &value);
+
+ private:
+  /**
+   * \brief Appends the text of a value to line
+   * \return false if it has no text that parses to it
+   */
+  bool appendValue(const configValue &value);
+
+  /**
+   * \brief Checks that line is a setting of a value that scans back to the
+   * given type, name and value text
+   */
+  bool scansAs(std::string_view type, std::string_view name, size_t valueStart) const;
+
+  std::ostream &out;
+
+  /** The section of the last header written.  */
+  std::string section;
+
+  /** The line being written, reused for every value.  */
+  std::string line;
+};
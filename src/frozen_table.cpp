@@ -0,0 +1,162 @@
+/**
+ * \author Lucas Kramer
+ * \file  frozen_table.cpp
+ * \brief Implementation of the read-only perfect hash table.  
+ * \details See frozen_table.h for more information.  
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <vector>
+using namespace std;
+
+#include "frozen_table.h"
+#include "compiled.h"
+
+/** The average number of names per bucket.  */
+static const size_t BUCKET_SIZE = 2;
+
+/** The most displacements tried for one bucket before picking a new seed.  */
+static const uint32_t MAX_DISPLACEMENT = 1 << 16;
+
+/** The most seeds tried before giving up.  */
+static const unsigned MAX_SEEDS = 64;
+
+uint64_t frozenTable::hash(string_view name, uint64_t seed) {
+  // Hash 8 bytes at a time
+  uint64_t h = mix(seed ^ (name.size() * 0x9e3779b97f4a7c15ULL));
+  const char *p = name.data();
+  size_t n = name.size();
+  for (; n >= 8; p += 8, n -= 8) {
+    uint64_t k;
+    memcpy(&k, p, 8);
+    h = (h ^ mix(k)) * 0x9e3779b97f4a7c15ULL;
+  }
+  uint64_t k = 0;
+  memcpy(&k, p, n);
+  return mix(h ^ k);
+}
+
+frozenTable::frozenTable(const unordered_map<string_view, configValue> &values) {
+  for (seed = 0; seed < MAX_SEEDS; seed++) {
+    if (build(values))
+      return;
+  }
+  cerr << "Could not build perfect hash for " << values.size() << " configuration variables" << endl;
+  exit(1);
+}
+
+frozenTable::frozenTable(unique_ptr<const compiledImage> image) : seed(image->seed()), image(std::move(image)) {}
+
+frozenTable::~frozenTable() {}
+
+size_t frozenTable::size() const {
+  return image != NULL? image->size() : entries.size();
+}
+
+const configValue *frozenTable::findInImage(string_view name) const {
+  size_t n = image->size();
+  if (n == 0)
+    return NULL;
+  uint64_t h = hash(name, seed);
+  const entry *e = image->find(slot(h, image->displacements()[reduce(h, image->numBuckets())], n), h, name);
+  return e != NULL? &e->value : NULL;
+}
+
+const frozenTable::entry *frozenTable::imageAt(size_t i) const {
+  return image->at(i);
+}
+
+bool frozenTable::build(const unordered_map<string_view, configValue> &values) {
+  size_t n = values.size();
+  entries.clear();
+  displacements.clear();
+  if (n == 0)
+    return true;
+
+  // Hash the names and group them into buckets, stored contiguously with
+  // the names of bucket b at members[start[b]] to members[start[b + 1]]
+  vector<entry> unplaced;
+  unplaced.reserve(n);
+  for (auto it = values.begin(); it != values.end(); it++)
+    unplaced.push_back({hash(it->first, seed), it->first, it->second});
+  size_t numBuckets = n / BUCKET_SIZE + 1;
+  displacements.assign(numBuckets, 0);
+  vector<size_t> start(numBuckets + 1, 0), members(n);
+  for (size_t i = 0; i < n; i++)
+    start[reduce(unplaced[i].hash, numBuckets) + 1]++;
+  size_t maxSize = 0;
+  for (size_t b = 0; b < numBuckets; b++) {
+    maxSize = max(maxSize, start[b + 1]);
+    start[b + 1] += start[b];
+  }
+  vector<size_t> fill(start.begin(), start.end() - 1);
+  for (size_t i = 0; i < n; i++)
+    members[fill[reduce(unplaced[i].hash, numBuckets)]++] = i;
+
+  // Place the largest buckets first, while most slots are free
+  vector<size_t> bySize(maxSize + 2, 0), order(numBuckets);
+  for (size_t b = 0; b < numBuckets; b++)
+    bySize[maxSize - (start[b + 1] - start[b]) + 1]++;
+  for (size_t i = 1; i < bySize.size(); i++)
+    bySize[i] += bySize[i - 1];
+  for (size_t b = 0; b < numBuckets; b++)
+    order[bySize[maxSize - (start[b + 1] - start[b])]++] = b;
+
+  entries.resize(n);
+  vector<bool> used(n, false);
+  vector<size_t> slots;
+  size_t nextFree = 0;
+  for (size_t b : order) {
+    const size_t *bucket = &members[start[b]];
+    size_t size = start[b + 1] - start[b];
+    if (size == 0)
+      break;
+    else if (size == 1) {
+      // A single entry can go in any free slot
+      while (used[nextFree])
+        nextFree++;
+      used[nextFree] = true;
+      entries[nextFree] = unplaced[bucket[0]];
+      displacements[b] = DIRECT | nextFree;
+      continue;
+    }
+
+    // Find a displacement that sends every entry in the bucket to a distinct free slot
+    uint32_t d;
+    for (d = 0; d < MAX_DISPLACEMENT; d++) {
+      slots.clear();
+      for (size_t i = 0; i < size; i++) {
+        size_t s = slot(unplaced[bucket[i]].hash, d, n);
+        if (used[s] || std::find(slots.begin(), slots.end(), s) != slots.end())
+          break;
+        slots.push_back(s);
+      }
+      if (slots.size() == size)
+        break;
+    }
+    if (d == MAX_DISPLACEMENT)
+      return false; // Also happens if two names have the same hash
+    for (size_t i = 0; i < size; i++) {
+      used[slots[i]] = true;
+      entries[slots[i]] = unplaced[bucket[i]];
+    }
+    displacements[b] = d;
+  }
+  return true;
+}
+
+configArray<uint32_t> frozenTable::sortedOrder() const {
+  if (image != NULL)
+    return image->sortedOrder();
+  call_once(sortOnce, [this] {
+    order.resize(entries.size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+      return entries[a].name < entries[b].name;
+    });
+  });
+  return configArray<uint32_t>(order.data(), order.size());
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  frozen_table.h
+ * \brief Read-only table of config values with a minimal perfect hash.  
+ */
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "configuration.h"
+
+class compiledImage;
+
+/**
+ * \brief A read-only table built from a ConfigTable once loading finishes.  
+ * \details Entries are stored contiguously, and found through a minimal
+ * perfect hash over the names: the hash of a name selects a bucket, whose
+ * displacement selects exactly one slot.  A lookup hashes the name once,
+ * reads one displacement and one entry, and compares the stored hash before
+ * comparing names.  Names and string values still point into the storage of
+ * the ConfigTable, which must outlive this table.  A table can also be read in
+ * place from a compiled image that was written with its layout, such as a
+ * shared configuration, so that attaching to it builds nothing.  
+ */
+class frozenTable {
+ public:
+  /** \brief An entry of the table */
+  struct entry {
+    uint64_t hash;
+    std::string_view name;
+    configValue value;
+  };
+
+  frozenTable() : seed(0) {}
+
+  /**
+   * \brief Builds the table
+   * \param values The values to include
+   */
+  explicit frozenTable(const std::unordered_map<std::string_view, configValue> &values);
+
+  /**
+   * \brief Reads a table in place from a compiled image
+   * \param image The image, which holds the layout of the table
+   */
+  explicit frozenTable(std::unique_ptr<const compiledImage> image);
+
+  ~frozenTable();
+
+  /**
+   * \brief Finds a value
+   * \param name The name of the value
+   * \return The value, or NULL if there is none with that name
+   */
+  const configValue *find(std::string_view name) const {
+    if (entries.empty())
+      return image != NULL? findInImage(name) : NULL;
+    uint64_t h = hash(name, seed);
+    const entry &e = entries[slot(h, displacements[reduce(h, displacements.size())], entries.size())];
+    return e.hash == h && e.name == name? &e.value : NULL;
+  }
+
+  /** \brief Gets the number of entries */
+  size_t size() const;
+
+  /**
+   * \brief Gets an entry
+   * \param i The slot of the entry, less than size(); slots are in no
+   * particular order
+   * \return The entry, or NULL for an entry of an image that is corrupt, which
+   * is treated as missing
+   */
+  const entry *at(size_t i) const {
+    return image == NULL? &entries[i] : imageAt(i);
+  }
+
+  /**
+   * \brief Gets the slots of the entries, in order of name
+   * \details The order is found the first time it is needed, so that loading
+   * does not pay for sorting, or read from the image.  
+   */
+  configArray<uint32_t> sortedOrder() const;
+
+  /**
+   * \brief Gets the slot of a value in a table that was not read from an image
+   */
+  size_t indexOf(const configValue *value) const {
+    return ((const char *)value - (const char *)&entries[0].value) / sizeof(entry);
+  }
+
+  /** \brief Gets the seed of the hash function, for writing the layout */
+  uint64_t getSeed() const { return seed; }
+
+  /** \brief Gets the displacement of each bucket, for writing the layout */
+  const std::vector<uint32_t> &getDisplacements() const { return displacements; }
+
+  /**
+   * \brief Hashes a name
+   * \param name The name
+   * \param seed Selects the hash function
+   * \return The hash
+   */
+  static uint64_t hash(std::string_view name, uint64_t seed);
+
+ private:
+  /** Set in a displacement to place a single entry directly in a slot.  */
+  static const uint32_t DIRECT = 0x80000000u;
+
+  /** \brief Maps a hash into [0, n) without division */
+  static size_t reduce(uint64_t h, size_t n) {
+    return (size_t)(((unsigned __int128)h * n) >> 64);
+  }
+
+  static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 33);
+  }
+
+  /** \brief Gets the slot of a hash in a table of n entries */
+  static size_t slot(uint64_t h, uint32_t displacement, size_t n) {
+    if (displacement & DIRECT)
+      return displacement & ~DIRECT;
+    return reduce(mix(h + displacement * 0x9e3779b97f4a7c15ULL), n);
+  }
+
+  bool build(const std::unordered_map<std::string_view, configValue> &values);
+
+  const configValue *findInImage(std::string_view name) const;
+  const entry *imageAt(size_t i) const;
+
+  uint64_t seed;
+  std::vector<uint32_t> displacements;
+  std::vector<entry> entries;
+
+  /** The image the table is read from, in which case entries is empty.  */
+  std::unique_ptr<const compiledImage> image;
+
+  mutable std::once_flag sortOnce;
+  mutable std::vector<uint32_t> order;
+};
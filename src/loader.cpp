@@ -0,0 +1,955 @@
+/**
+ * \author Lucas Kramer
+ * \file  loader.cpp
+ * \brief Implementation of configuration file loading.  
+ * \details See loader.h for more information.  
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ctype.h>
+#include <math.h>
+#include <new>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+#include "loader.h"
+#include "arena.h"
+#include "mapped_file.h"
+#include "scanner.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+/** The most threads used to read included files.  */
+static const unsigned MAX_LOAD_THREADS = 8;
+
+/**
+ * \brief Skips leading whitespace and a sign, as an istream does
+ * \return false if the text is negative
+ */
+static bool skipSign(string_view &text) {
+  while (!text.empty() && isspace((unsigned char)text[0]))
+    text.remove_prefix(1);
+  bool negative = !text.empty() && text[0] == '-';
+  if (!text.empty() && (text[0] == '+' || text[0] == '-'))
+    text.remove_prefix(1);
+  return !negative;
+}
+
+/**
+ * \brief Parses an integer, accepting the same text as reading it from an
+ * istream in the given base, without the cost of creating the stream
+ * \details The whole text must be used, and the value must fit in T.  
+ */
+template <typename T>
+static bool parseInteger(string_view text, int base, T &result) {
+  bool positive = skipSign(text);
+  if (base == 16 && text.size() >= 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+    text.remove_prefix(2);
+
+  unsigned long long magnitude;
+  const char *end = text.data() + text.size();
+  from_chars_result r = from_chars(text.data(), end, magnitude, base);
+  if (r.ec != errc() || r.ptr != end)
+    return false;
+
+  unsigned long long max = (unsigned long long)numeric_limits<T>::max();
+  if (positive) {
+    if (magnitude > max)
+      return false;
+    result = (T)magnitude;
+  }
+  else {
+    if (magnitude > max + 1)
+      return false;
+    // Negate in the unsigned type, so that the minimum value does not overflow
+    result = (T)(0 - magnitude);
+  }
+  return true;
+}
+
+/**
+ * \brief Parses a floating point number, accepting the same text as reading it
+ * from an istream
+ * \details As with an istream, infinities, NaNs, and hex floats are rejected,
+ * values too large for T are errors, and values too small for T become 0.  
+ */
+template <typename T>
+static bool parseFloat(string_view text, T &result) {
+  string_view digits = text;
+  bool positive = skipSign(digits);
+  if (digits.empty() || !(isdigit((unsigned char)digits[0]) || digits[0] == '.'))
+    return false;
+  // from_chars accepts a minus sign, but not a plus sign
+  if (!positive)
+    digits = string_view(digits.data() - 1, digits.size() + 1);
+
+  const char *end = digits.data() + digits.size();
+  from_chars_result r = from_chars(digits.data(), end, result, chars_format::general);
+  if (r.ptr != end)
+    return false;
+  if (r.ec == errc::result_out_of_range) {
+    // Tell underflow from overflow with a wider type, or failing that by the
+    // sign of the exponent
+    long double wide;
+    r = from_chars(digits.data(), end, wide, chars_format::general);
+    if (r.ec == errc())
+      wide = fabsl(wide) < 1? wide : NAN;
+    else {
+      size_t e = digits.find_first_of("eE");
+      wide = e != string_view::npos && digits.substr(e + 1, 1) == "-"? (positive? 0.0L : -0.0L) : NAN;
+    }
+    if (isnan(wide))
+      return false;
+    result = (T)wide;
+  }
+  else if (r.ec != errc())
+    return false;
+  return true;
+}
+
+/**
+ * \brief Splits the text of an array, including the brackets, into the text of
+ * its elements
+ * \return false if the brackets are missing or an element is empty
+ */
+static bool splitArray(string_view text, vector<string_view> &elements) {
+  while (!text.empty() && isspace((unsigned char)text.back()))
+    text.remove_suffix(1);
+  if (text.size() < 2 || text.front() != '[' || text.back() != ']')
+    return false;
+  text = text.substr(1, text.size() - 2);
+  if (text.find_first_not_of(' ') == string_view::npos)
+    return true;
+
+  bool quoted = false;
+  size_t start = 0;
+  for (size_t i = 0; i <= text.size(); i++) {
+    if (i == text.size() || (text[i] == ',' && !quoted)) {
+      string_view element = text.substr(start, i - start);
+      size_t first = element.find_first_not_of(' ');
+      if (first == string_view::npos)
+        return false;
+      elements.push_back(element.substr(first, element.find_last_not_of(' ') + 1 - first));
+      start = i + 1;
+    }
+    else if (text[i] == '"')
+      quoted = !quoted;
+  }
+  return !quoted;
+}
+
+/**
+ * \brief Parses the elements of an array into contiguous storage in the arena
+ */
+template <typename T, typename F>
+static bool parseArray(const vector<string_view> &elements, configArena &arena, configValue &value,
+                       F parseElement) {
+  T *result = (T *)arena.allocate(max<size_t>(elements.size(), 1) * sizeof(T), alignof(T));
+  for (size_t i = 0; i < elements.size(); i++) {
+    new (&result[i]) T();
+    if (!parseElement(elements[i], result[i]))
+      return false;
+  }
+  value.arrayVal = result;
+  value.length = elements.size();
+  return true;
+}
+
+/**
+ * \brief Parses a quoted string element of an array
+ */
+static bool parseQuoted(string_view text, string_view &result) {
+  if (text.size() < 2 || text.front() != '"' || text.back() != '"')
+    return false;
+  result = text.substr(1, text.size() - 2);
+  return result.find('"') == string_view::npos;
+}
+
+/**
+ * \brief Parses the text of an array value
+ * \param elementType The type name of the elements
+ */
+static parseStatus parseArrayValue(string_view elementType, string_view valueText, configValue &value,
+                                   configArena &arena) {
+  int base = elementType == "hex"? 16 : elementType == "octal"? 8 : 10;
+  bool ok;
+  vector<string_view> elements;
+  if (elementType == "int" || elementType == "hex" || elementType == "octal") {
+    value.type = CONFIG_INT_ARRAY;
+    ok = splitArray(valueText, elements) &&
+      parseArray<int>(elements, arena, value, [base](string_view text, int &result) {
+        return parseInteger(text, base, result);
+      });
+  }
+  else if (elementType == "long") {
+    value.type = CONFIG_LONG_ARRAY;
+    ok = splitArray(valueText, elements) &&
+      parseArray<long long>(elements, arena, value, [](string_view text, long long &result) {
+        return parseInteger(text, 10, result);
+      });
+  }
+  else if (elementType == "float") {
+    value.type = CONFIG_FLOAT_ARRAY;
+    ok = splitArray(valueText, elements) &&
+      parseArray<float>(elements, arena, value, parseFloat<float>);
+  }
+  else if (elementType == "double") {
+    value.type = CONFIG_DOUBLE_ARRAY;
+    ok = splitArray(valueText, elements) &&
+      parseArray<double>(elements, arena, value, parseFloat<double>);
+  }
+  else if (elementType == "string") {
+    // The elements point into valueText, which must outlive them
+    value.type = CONFIG_STRING_ARRAY;
+    ok = splitArray(valueText, elements) &&
+      parseArray<string_view>(elements, arena, value, parseQuoted);
+  }
+  else {
+    return PARSE_INVALID_TYPE_NAME;
+  }
+  return ok? PARSE_OK : PARSE_INVALID_SYNTAX;
+}
+
+parseStatus parseValue(string_view type, string_view valueText, configValue &value, configArena &arena) {
+  // Parse the value
+  value.unresolved = false;
+  value.unparsed = false;
+
+  if (type.size() > 2 && type.substr(type.size() - 2) == "[]")
+    return parseArrayValue(type.substr(0, type.size() - 2), valueText, value, arena);
+
+  bool formatError = false;
+  if (type == "int") {
+    formatError = !parseInteger(valueText, 10, value.intVal);
+    value.type = CONFIG_INT;
+  }
+  else if (type == "hex") {
+    formatError = !parseInteger(valueText, 16, value.intVal);
+    value.type = CONFIG_INT;
+  }
+  else if (type == "octal") {
+    formatError = !parseInteger(valueText, 8, value.intVal);
+    value.type = CONFIG_INT;
+  }
+  else if (type == "long") {
+    formatError = !parseInteger(valueText, 10, value.longVal);
+    value.type = CONFIG_LONG;
+  }
+  else if (type == "float") {
+    formatError = !parseFloat(valueText, value.floatVal);
+    value.type = CONFIG_FLOAT;
+  }
+  else if (type == "double") {
+    formatError = !parseFloat(valueText, value.doubleVal);
+    value.type = CONFIG_DOUBLE;
+  }
+  else if (type == "bool" || type == "boolean") {
+    if (valueText == "true" || valueText == "1")
+      value.boolVal = true;
+    else if (valueText == "false" || valueText == "0")
+      value.boolVal = false;
+    else formatError = true;
+    value.type = CONFIG_BOOL;
+  }
+  else if (type == "char") {
+    // Either 'c' or a bare character
+    if (valueText.size() >= 2 && valueText[0] == '\'')
+      value.charVal = valueText[1];
+    else if (!valueText.empty())
+      value.charVal = valueText[0];
+    else formatError = true;
+    value.type = CONFIG_CHAR;
+  }
+  else if (type == "string") {
+    // Either "text" or bare text, up to the next quote.  The text may not be
+    // empty.  The value points into valueText, which must outlive it.  
+    string_view text = valueText;
+    if (!text.empty() && text[0] == '"')
+      text.remove_prefix(1);
+    text = text.substr(0, text.find('"'));
+    if (text.empty())
+      formatError = true;
+    value.stringVal = text.data();
+    value.length = text.size();
+    value.type = CONFIG_STRING;
+  }
+  else {
+    return PARSE_INVALID_TYPE_NAME;
+  }
+
+  // Check for syntax errors
+  if (formatError) {
+    return PARSE_INVALID_SYNTAX;
+  }
+
+  return PARSE_OK;
+}
+
+parseStatus valueType(string_view type, configType &result) {
+  bool array = type.size() > 2 && type.substr(type.size() - 2) == "[]";
+  if (array)
+    type.remove_suffix(2);
+  if (type == "int" || type == "hex" || type == "octal")
+    result = array? CONFIG_INT_ARRAY : CONFIG_INT;
+  else if (type == "long")
+    result = array? CONFIG_LONG_ARRAY : CONFIG_LONG;
+  else if (type == "float")
+    result = array? CONFIG_FLOAT_ARRAY : CONFIG_FLOAT;
+  else if (type == "double")
+    result = array? CONFIG_DOUBLE_ARRAY : CONFIG_DOUBLE;
+  else if (type == "string")
+    result = array? CONFIG_STRING_ARRAY : CONFIG_STRING;
+  else if (!array && (type == "bool" || type == "boolean"))
+    result = CONFIG_BOOL;
+  else if (!array && type == "char")
+    result = CONFIG_CHAR;
+  else return PARSE_INVALID_TYPE_NAME;
+  return PARSE_OK;
+}
+
+void mergeConfigTables(ConfigTable &dest, const ConfigTable &src, bool overwrite) {
+  dest.values.reserve(dest.values.size() + src.values.size());
+  for (auto it = src.values.begin(); it != src.values.end(); it++) {
+    if (overwrite)
+      dest.values.insert_or_assign(it->first, it->second);
+    else dest.values.insert(*it);
+  }
+  dest.keepStorage(src);
+}
+
+/**
+ * \brief Normalizes a path, removing empty and . components and directories
+ * followed by ..
+ * \details This is done on the text alone, so a directory that is a symbolic
+ * link followed by .. is treated as if it were not a link.  
+ */
+static string normalPath(string_view path) {
+  bool absolute = !path.empty() && path[0] == '/';
+  vector<string_view> components;
+  for (size_t start = 0; start <= path.size(); ) {
+    size_t end = min(path.find('/', start), path.size());
+    string_view component = path.substr(start, end - start);
+    if (component == "..") {
+      if (!components.empty() && components.back() != "..")
+        components.pop_back();
+      else if (!absolute)
+        components.push_back(component);
+    }
+    else if (!component.empty() && component != ".")
+      components.push_back(component);
+    start = end + 1;
+  }
+
+  string result = absolute? "/" : "";
+  for (size_t i = 0; i < components.size(); i++) {
+    if (i != 0)
+      result += '/';
+    result.append(components[i]);
+  }
+  return result.empty()? "." : result;
+}
+
+/**
+ * \brief Resolves an included filename relative to the directory of the
+ * including file.  
+ * \details The path is normalized, so that the same file included as
+ * common.cfg and as env/../common.cfg is only read once.  
+ */
+static string includePath(const string &filename, string_view included) {
+  size_t slash = filename.rfind('/');
+  if (slash == string::npos)
+    return normalPath(included);
+  return normalPath(filename.substr(0, slash + 1).append(included));
+}
+
+/**
+ * \brief Gets the full name of a value in a section, SECTION.NAME
+ */
+static string_view sectionName(configArena &arena, string_view section, string_view name) {
+  char *result = (char *)arena.allocate(section.size() + 1 + name.size(), 1);
+  memcpy(result, section.data(), section.size());
+  result[section.size()] = '.';
+  memcpy(result + section.size() + 1, name.data(), name.size());
+  return string_view(result, section.size() + 1 + name.size());
+}
+
+/**
+ * \brief A line of a parsed file that affects the resulting table.  
+ */
+struct parsedEntry {
+  lineKind kind;
+  int lineNum;
+
+  /**
+   * For LINE_SETTING, the name, including the section, and value.  The value
+   * starts zeroed, since parseValue only sets the fields its type uses and
+   * values are compared bitwise.  
+   */
+  string_view name;
+  configValue value = {};
+
+  /** For LINE_INCLUDE, the path of the included file.  */
+  string include;
+
+  /** For LINE_ERROR, the error message.  */
+  string message;
+};
+
+/**
+ * \brief The lines of a file, parsed but not yet merged with its includes.  
+ * \details Parsing stops at the first error, which is the last entry.  
+ */
+struct parsedFile {
+  string filename;
+
+  /** The version of the file that was parsed, taken before reading it.  */
+  fileStamp stamp;
+
+  /** If values other than strings were left unparsed.  */
+  bool lazy;
+
+  /** If the file was copied into memory rather than mapped.  */
+  bool copied = false;
+
+  /** If the file could be opened.  */
+  bool opened = false;
+
+  /** If reading a streamed file failed after the last entry.  */
+  bool readFailed = false;
+
+  /** The size of the text.  */
+  size_t size = 0;
+
+  /**
+   * The buffers holding the text, which values point into: the mapped file,
+   * or the chunks of a stream.  
+   */
+  vector<shared_ptr<const void>> text;
+
+  /**
+   * Holds the elements of arrays and the names of values in sections, which
+   * nothing is allocated from for most files.  
+   */
+  shared_ptr<configArena> arrays;
+
+  vector<parsedEntry> entries;
+};
+
+bool parseCache::changed() const {
+  if (files.empty() && unparsed.empty())
+    return true;
+  for (auto it = files.begin(); it != files.end(); it++) {
+    if (!(fileStamp::of(it->first) == it->second->stamp))
+      return true;
+  }
+  for (auto it = unparsed.begin(); it != unparsed.end(); it++) {
+    if (!(fileStamp::of(it->first) == it->second))
+      return true;
+  }
+  return false;
+}
+
+void parseCache::clear() {
+  files.clear();
+  unparsed.clear();
+}
+
+void parseCache::addUnparsed(const vector<string> &filenames, const vector<fileStamp> &stamps) {
+  for (size_t i = 0; i < filenames.size() && i < stamps.size(); i++)
+    unparsed[filenames[i]] = stamps[i];
+}
+
+const fileStamp *parseCache::stampOf(const string &filename) const {
+  auto it = files.find(filename);
+  return it != files.end() && it->second != NULL? &it->second->stamp : NULL;
+}
+
+/**
+ * \brief Parses the lines of a file into its entries
+ * \details Parsing stops at the first error.  
+ * \param file The file, with its name set
+ * \param lines Gives the lines of the file, which must outlive the entries
+ * \param lazy If values other than strings are left unparsed
+ * \param include Called with the filename of each use line, and returns the
+ * name of the included file after starting to parse it
+ */
+template <typename Lines, typename Include>
+static void parseLines(parsedFile &file, Lines &lines, bool lazy, Include include) {
+  file.arrays = make_shared<configArena>(256);
+  string_view line;
+
+  // The section of the following settings, which lasts until the end of the file
+  string_view section;
+
+  // Unparsed values point to the name of the file, kept with the arena
+  string_view filename = lazy? file.arrays->copy(file.filename) : string_view();
+
+  // Iterate over all lines and update the line number
+  for (int lineNum = 1; lines.next(line); lineNum++) {
+    scannedLine scanned = scanLine(line);
+    if (scanned.kind == LINE_BLANK)
+      continue;
+    if (scanned.kind == LINE_SECTION) {
+      section = scanned.name;
+      continue;
+    }
+
+    parsedEntry entry;
+    entry.kind = scanned.kind;
+    entry.lineNum = lineNum;
+    if (scanned.kind == LINE_INCLUDE) {
+      entry.include = include(scanned.value);
+    }
+    else if (scanned.kind == LINE_ERROR) {
+      entry.message = "Unexpected end of line";
+    }
+    else {
+      // Parse the value and check for errors.  Unparsed values still have their
+      // type checked, and strings are always parsed for expanding references.  
+      parseStatus status;
+      if (lazy && (status = valueType(scanned.type, entry.value.type)) == PARSE_OK &&
+          entry.value.type != CONFIG_STRING) {
+        unparsedValue *text = (unparsedValue *)file.arrays->allocate(sizeof(unparsedValue),
+                                                                    alignof(unparsedValue));
+        new (text) unparsedValue{scanned.type, scanned.value, filename, lineNum};
+        entry.value.unresolved = false;
+        entry.value.unparsed = true;
+        entry.value.length = 0;
+        entry.value.arrayVal = text;
+      }
+      else status = parseValue(scanned.type, scanned.value, entry.value, *file.arrays);
+      if (status == PARSE_INVALID_TYPE_NAME) {
+        entry.kind = LINE_ERROR;
+        entry.message = "Invalid type name " + string(scanned.type);
+      }
+      else if (status == PARSE_INVALID_SYNTAX) {
+        entry.kind = LINE_ERROR;
+        entry.message = "Invalid value format";
+      }
+      entry.name = section.empty()? scanned.name : sectionName(*file.arrays, section, scanned.name);
+    }
+    file.entries.push_back(std::move(entry));
+    if (file.entries.back().kind == LINE_ERROR)
+      return;
+  }
+}
+
+/**
+ * \brief Parses a file and everything it includes, reading included files in
+ * parallel as they are found.  
+ * \details Files that are unchanged since a previous load are reused from its
+ * cache instead of being read again.  
+ */
+class includeLoader {
+ public:
+  /**
+   * \param previous The files parsed by a previous load, or NULL
+   * \param lazy If values other than strings are left unparsed
+   * \param copy If files are copied into memory rather than mapped
+   */
+  includeLoader(const parseCache *previous, bool lazy, bool copy = false) :
+    previous(previous), lazy(lazy), copy(copy), pending(0) {}
+
+  /**
+   * \brief Parses a file on the calling thread, and waits until all files it
+   * includes have been parsed
+   * \return The parsed files, by path
+   */
+  parseCache parseAll(const string &filename) {
+    {
+      lock_guard<mutex> lock(filesMutex);
+      files.files[filename];
+    }
+    process(filename);
+
+    unique_lock<mutex> lock(filesMutex);
+    finished.wait(lock, [this] { return pending == 0; });
+    return std::move(files);
+  }
+
+ private:
+  /**
+   * \brief Starts parsing an included file, if it has not been started already
+   */
+  void schedule(const string &filename) {
+    lock_guard<mutex> lock(filesMutex);
+    if (files.files.count(filename))
+      return;
+    files.files[filename];
+    if (pool == NULL)
+      pool.reset(new threadPool(min(MAX_LOAD_THREADS, max(thread::hardware_concurrency(), 1u))));
+    pending++;
+    pool->submit([this, filename] {
+      process(filename);
+      lock_guard<mutex> lock(filesMutex);
+      if (--pending == 0)
+        finished.notify_all();
+    });
+  }
+
+  /**
+   * \brief Parses a file, or reuses the previous parse if it is unchanged
+   */
+  void process(const string &filename) {
+#ifdef CONFIG_STATS
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+#endif
+    fileStamp stamp = fileStamp::of(filename);
+    shared_ptr<const parsedFile> result;
+    if (previous != NULL) {
+      auto it = previous->files.find(filename);
+      if (it != previous->files.end() && it->second->stamp == stamp && it->second->lazy == lazy &&
+          it->second->copied == copy)
+        result = it->second;
+    }
+    bool reused = result != NULL;
+    if (reused) {
+      for (const parsedEntry &entry : result->entries) {
+        if (entry.kind == LINE_INCLUDE)
+          schedule(entry.include);
+      }
+    }
+    else {
+      shared_ptr<parsedFile> file = make_shared<parsedFile>();
+      file->filename = filename;
+      file->stamp = stamp;
+      file->lazy = lazy;
+      file->copied = copy;
+      parse(*file);
+      result = file;
+    }
+#ifdef CONFIG_STATS
+    recordParse(filename, result->size,
+                chrono::duration<double, milli>(chrono::steady_clock::now() - start).count(), reused);
+#endif
+    lock_guard<mutex> lock(filesMutex);
+    files.files[filename] = result;
+  }
+
+  void parse(parsedFile &file) {
+    shared_ptr<const mappedFile> input = copy? mappedFile::read(file.filename) : mappedFile::open(file.filename);
+    if (input == NULL)
+      return;
+    file.opened = true;
+    file.size = input->contents().size();
+    file.text.push_back(input);
+
+    lineReader lines(input->contents());
+    parseLines(file, lines, lazy, [this, &file](string_view included) {
+      string path = includePath(file.filename, included);
+      schedule(path);
+      return path;
+    });
+  }
+
+  const parseCache *previous;
+  bool lazy;
+  bool copy;
+
+  mutex filesMutex;
+  condition_variable finished;
+
+  /** The files that have been scheduled, set once they are parsed.  */
+  parseCache files;
+
+  /** The number of scheduled files that have not finished parsing.  */
+  unsigned pending;
+
+  /** Created when the first include is found.  */
+  unique_ptr<threadPool> pool;
+};
+
+/**
+ * \brief Checks if two values are the same value of the same entry, as they
+ * are when a file is included again
+ */
+static bool sameBits(const configValue &a, const configValue &b) {
+  return a.type == b.type && a.unparsed == b.unparsed && a.length == b.length &&
+    memcmp(&a.intVal, &b.intVal, sizeof(configValue) - offsetof(configValue, intVal)) == 0;
+}
+
+/**
+ * \brief Builds the table for a parsed file, merging its includes in order
+ * and reporting warnings and errors as if the files were read sequentially.  
+ * \details Included files are walked in place rather than built into tables
+ * of their own, so each value is added once per inclusion and the buffers of
+ * each file are kept once, however deeply the files are nested.  Building stops
+ * at the first error, including a use line that includes a file that is
+ * already being included.  
+ */
+bool buildTable(const parseCache &files, const parsedFile &file, ConfigTable &result,
+                vector<configError> &errors) {
+  // Names outside of sections are shorter than their lines, so the arena
+  // rarely needs a second block
+  result = ConfigTable(file.size + 1);
+
+  // The files being walked, from the root, with the next entry of each
+  struct link {
+    const parsedFile *file;
+    size_t next;
+    /** If the file was already merged by an earlier use line.  */
+    bool again;
+    /** The number of files entered, including this one, when it was entered.  */
+    uint32_t enteredAt;
+  };
+  vector<link> chain;
+  unordered_set<const parsedFile *> active, kept;
+
+  // The number of files entered when each value was last bound, which tells
+  // where it was bound relative to the files being walked.  It is kept in the
+  // arena in front of the copy of the name, so that finding the value finds it.
+  uint32_t entered = 0;
+  auto boundAt = [](string_view name) -> uint32_t & {
+    return *(uint32_t *)(name.data() - sizeof(uint32_t));
+  };
+  auto enter = [&](const parsedFile &included) {
+    // Check if the file could be opened
+    if (!included.opened) {
+      errors.push_back(configError{CONFIG_ERROR_MISSING_FILE, included.filename, 0, ""});
+      return false;
+    }
+    // String values point into the text, and arrays into the file's arena
+    bool again = !kept.insert(&included).second;
+    if (!again) {
+      result.storage.insert(result.storage.end(), included.text.begin(), included.text.end());
+      result.storage.push_back(included.arrays);
+      result.sources.push_back(included.filename);
+    }
+    chain.push_back(link{&included, 0, again, ++entered});
+    active.insert(&included);
+    return true;
+  };
+  if (!enter(file))
+    return false;
+
+  while (!chain.empty()) {
+    const parsedFile &current = *chain.back().file;
+    if (chain.back().next == current.entries.size()) {
+      if (current.readFailed) {
+        errors.push_back(configError{CONFIG_ERROR_READ, current.filename, 0, ""});
+        return false;
+      }
+      active.erase(&current);
+      chain.pop_back();
+      continue;
+    }
+
+    const parsedEntry &entry = current.entries[chain.back().next++];
+    if (entry.kind == LINE_INCLUDE) {
+      const parsedFile &included = *files.files.at(entry.include);
+      if (active.count(&included)) {
+        string cycle;
+        for (const link &outer : chain)
+          cycle += outer.file->filename + " -> ";
+        errors.push_back(configError{CONFIG_ERROR_INCLUDE_CYCLE, current.filename, entry.lineNum,
+                                     cycle + included.filename});
+        return false;
+      }
+      if (!enter(included))
+        return false;
+    }
+    else if (entry.kind == LINE_ERROR) {
+      errors.push_back(configError{CONFIG_ERROR_SYNTAX, current.filename, entry.lineNum, entry.message});
+      return false;
+    }
+    else {
+      // Add the value to the result table.  
+      auto it = result.values.find(entry.name);
+      if (it == result.values.end()) {
+        char *copy = (char *)result.arena->allocate(sizeof(uint32_t) + entry.name.size() + 1, alignof(uint32_t));
+        string_view name(copy + sizeof(uint32_t), entry.name.size());
+        memcpy(copy + sizeof(uint32_t), entry.name.data(), entry.name.size());
+        copy[sizeof(uint32_t) + entry.name.size()] = '\0';
+        boundAt(name) = entered;
+        result.values.emplace(name, entry.value);
+        continue;
+      }
+      // Including a file again rebinds its values, but a value it still has
+      // is not a redefinition.  
+      uint32_t &bound = boundAt(it->first);
+      if (!chain.back().again || !sameBits(it->second, entry.value)) {
+        // Warn as if each included file were loaded into a table of its own and
+        // then merged into the file using it: a value bound since entering this
+        // file is bound again at this line, and one bound before is bound again
+        // by the include entered first after it
+        auto by = upper_bound(chain.begin(), chain.end(), bound, [](uint32_t stamp, const link &l) {
+          return stamp < l.enteredAt;
+        });
+        if (by == chain.end())
+          cerr << "Warning when parsing configuration file " << current.filename << " at line " <<
+            entry.lineNum << ": Configuration variable " << entry.name << " is already bound" << endl;
+        else cerr << "Warning when parsing include of configuration file " << by->file->filename <<
+               ": Configuration variable " << entry.name << " is already bound" << endl;
+      }
+      bound = entered;
+      it->second = entry.value;
+    }
+  }
+  return true;
+}
+
+bool loadConfig(const string &filename, ConfigTable &result, vector<configError> &errors) {
+  parseCache files = includeLoader(NULL, false).parseAll(filename);
+  return buildTable(files, *files.files.at(filename), result, errors);
+}
+
+bool loadConfig(const string &filename, parseCache &cache, ConfigTable &result,
+                vector<configError> &errors, bool lazy, bool copy) {
+  parseCache files = includeLoader(&cache, lazy, copy).parseAll(filename);
+  bool ok = buildTable(files, *files.files.at(filename), result, errors);
+  // Keep the files even if loading failed, so that they are only read again
+  // once they change
+  cache = std::move(files);
+  return ok;
+}
+
+/** The size of the buffers a stream is read into.  */
+static const size_t STREAM_CHUNK_SIZE = 65536;
+
+/**
+ * \brief Splits a stream into lines as its chunks arrive, like lineReader.  
+ * \details Lines are returned as soon as they are complete.  Chunks are read
+ * into buffers kept with the parsed file, and only a line split between two
+ * buffers is copied.  
+ */
+class chunkedLines {
+ public:
+  chunkedLines(const configChunkReader &reader, parsedFile &file) : reader(reader), file(file) {}
+
+  bool next(string_view &line) {
+    while (true) {
+      const char *end = pos < filled? (const char *)memchr(buffer + pos, '\n', filled - pos) : NULL;
+      if (end != NULL) {
+        line = string_view(buffer + pos, end - (buffer + pos));
+        pos = end - buffer + 1;
+        return true;
+      }
+      if (ended) {
+        if (pos == filled)
+          return false;
+        line = string_view(buffer + pos, filled - pos);
+        pos = filled;
+        return true;
+      }
+
+      if (filled == capacity) {
+        // Start a new buffer with the incomplete line
+        size_t carried = filled - pos;
+        capacity = max(STREAM_CHUNK_SIZE, carried * 2);
+        shared_ptr<char> next(new char[capacity], default_delete<char[]>());
+        if (carried != 0)
+          memcpy(next.get(), buffer + pos, carried);
+        file.text.push_back(next);
+        buffer = next.get();
+        filled = carried;
+        pos = 0;
+      }
+      long n = reader(buffer + filled, capacity - filled);
+      if (n < 0)
+        file.readFailed = true;
+      if (n <= 0)
+        ended = true;
+      else {
+        filled += n;
+        file.size += n;
+      }
+    }
+  }
+
+ private:
+  const configChunkReader &reader;
+  parsedFile &file;
+
+  char *buffer = NULL;
+  size_t capacity = 0;
+  size_t filled = 0;
+  size_t pos = 0;
+  bool ended = false;
+};
+
+/**
+ * \brief Parses a stream and the streams it includes, in the order they are
+ * found.  
+ * \param reader The stream, or an empty function if it could not be opened
+ * \param files The parsed streams, by name
+ */
+static void parseStream(const string &name, const configChunkReader &reader, const configIncludeResolver &resolver,
+                        bool lazy, unordered_map<string, shared_ptr<const parsedFile>> &files) {
+  shared_ptr<parsedFile> file = make_shared<parsedFile>();
+  file->filename = name;
+  file->lazy = lazy;
+  files[name] = file;
+  if (!reader)
+    return;
+  file->opened = true;
+
+  // Included streams are parsed once they are reached, on the same thread
+  chunkedLines lines(reader, *file);
+  parseLines(*file, lines, lazy, [&](string_view included) {
+    string includedName;
+    configChunkReader includedReader = resolver(name, included, includedName);
+    if (includedName.empty())
+      includedName = string(included);
+    if (!files.count(includedName))
+      parseStream(includedName, includedReader, resolver, lazy, files);
+    return includedName;
+  });
+}
+
+bool loadConfigStream(const string &name, const configChunkReader &reader, const configIncludeResolver &resolver,
+                      ConfigTable &result, vector<configError> &errors, bool lazy) {
+  parseCache files;
+  parseStream(name, reader, resolver, lazy, files.files);
+  return buildTable(files, *files.files.at(name), result, errors);
+}
+
+configChunkReader configReadFd(int fd) {
+  return [fd](char *buffer, size_t size) {
+    ssize_t n;
+    do n = read(fd, buffer, size);
+    while (n < 0 && errno == EINTR);
+    return (long)n;
+  };
+}
+
+configChunkReader configReadStream(istream &in) {
+  return [&in](char *buffer, size_t size) {
+    // Return what is available as it arrives, rather than waiting for a full buffer
+    in.read(buffer, 1);
+    if (in.gcount() == 0)
+      return in.eof()? 0L : -1L;
+    streamsize n = 1 + in.readsome(buffer + 1, size - 1);
+    return (long)n;
+  };
+}
+
+configIncludeResolver configFileResolver() {
+  return [](const string &including, string_view included, string &name) -> configChunkReader {
+    name = includePath(including, included);
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0)
+      return configChunkReader();
+    // Closes the file once the reader is done with
+    shared_ptr<void> closer(NULL, [fd](void *) { close(fd); });
+    configChunkReader reader = configReadFd(fd);
+    return [reader, closer](char *buffer, size_t size) { return reader(buffer, size); };
+  };
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  loader.h
+ * \brief Internal interface for parsing configuration files into ConfigTables.  
+ * \details See configuration.h for a description of the format.  
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "configuration.h"
+
+class configArena;
+
+/**
+ * \brief Parses the text of a value
+ * \details String values and string array elements point into valueText, which
+ * must outlive them.  
+ * \param type The type name, as written in the file
+ * \param valueText The text of the value
+ * \param value Set to the parsed value
+ * \param arena Holds the elements of arrays
+ * \return The result of parsing
+ */
+parseStatus parseValue(std::string_view type, std::string_view valueText, configValue &value,
+                       configArena &arena);
+
+/**
+ * \brief Gets the type of the values of a type name, without parsing a value
+ * \param type The type name, as written in the file
+ * \param result Set to the type
+ * \return PARSE_OK, or PARSE_INVALID_TYPE_NAME
+ */
+parseStatus valueType(std::string_view type, configType &result);
+
+/**
+ * \brief The text of a value that is parsed when it is first read.  
+ * \details Points into the file the value was read from, and is pointed to by
+ * the arrayVal of the configValue.  
+ */
+struct unparsedValue {
+  std::string_view type;
+  std::string_view text;
+  std::string_view filename;
+  int line;
+};
+
+/**
+ * \brief Adds the values of one table to another in place
+ * \param dest The table to add to
+ * \param src The table to add
+ * \param overwrite If values of src replace those in dest with the same name,
+ * rather than being skipped
+ */
+void mergeConfigTables(ConfigTable &dest, const ConfigTable &src, bool overwrite);
+
+/**
+ * \brief Identifies a version of a file on disk.  
+ */
+struct fileStamp {
+  bool exists;
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  struct timespec modified;
+
+  static fileStamp of(const std::string &filename) {
+    struct stat st;
+    fileStamp result;
+    memset(&result, 0, sizeof(result));
+    if (stat(filename.c_str(), &st) == 0) {
+      result.exists = true;
+      result.device = st.st_dev;
+      result.inode = st.st_ino;
+      result.size = st.st_size;
+      result.modified = st.st_mtim;
+    }
+    return result;
+  }
+
+  bool operator==(const fileStamp &other) const {
+    return exists == other.exists && device == other.device && inode == other.inode &&
+      size == other.size && modified.tv_sec == other.modified.tv_sec &&
+      modified.tv_nsec == other.modified.tv_nsec;
+  }
+};
+
+struct parsedFile;
+
+/**
+ * \brief The parsed files of a load, kept so that later loads only re-parse
+ * the files that changed.  
+ * \details Files are compared by device, inode, size, and modification time.  
+ * Since string values point into the mapped files, files must be replaced
+ * (written under a new name and renamed over the old one) rather than edited
+ * in place while a configuration loaded from them is in use, unless they were
+ * loaded with copy set.  
+ */
+class parseCache {
+ public:
+  /**
+   * \brief Checks if any of the files changed since they were parsed
+   * \return true if so, or if the cache is empty
+   */
+  bool changed() const;
+
+  void clear();
+
+  /**
+   * \brief Gets the version of a file that was parsed
+   * \return The version, taken before the file was read, or NULL if the file
+   * was not part of the load
+   */
+  const fileStamp *stampOf(const std::string &filename) const;
+
+  /**
+   * \brief Records files that a load used without parsing them, such as the
+   * sources of a compiled file, so that changed() checks them too
+   * \details The files are not reused by later loads, which parse them.  
+   * \param filenames The files
+   * \param stamps The version of each file that was used
+   */
+  void addUnparsed(const std::vector<std::string> &filenames, const std::vector<fileStamp> &stamps);
+
+ private:
+  friend class includeLoader;
+  friend bool loadConfig(const std::string &filename, ConfigTable &result,
+                         std::vector<configError> &errors);
+  friend bool loadConfig(const std::string &filename, parseCache &cache, ConfigTable &result,
+                         std::vector<configError> &errors, bool lazy, bool copy);
+  friend bool loadConfigStream(const std::string &name, const configChunkReader &reader,
+                               const configIncludeResolver &resolver, ConfigTable &result,
+                               std::vector<configError> &errors, bool lazy);
+  friend bool buildTable(const parseCache &files, const parsedFile &file, ConfigTable &result,
+                         std::vector<configError> &errors);
+
+  /** The files, by path.  */
+  std::unordered_map<std::string, std::shared_ptr<const parsedFile>> files;
+
+  /** The versions of the files used without parsing them, by path.  */
+  std::unordered_map<std::string, fileStamp> unparsed;
+};
+
+/**
+ * \brief Loads a configuration file and the files it includes
+ * \details Included files are read and parsed in parallel, each once however
+ * many times it is included, and then merged in the order they appear.  
+ * Loading stops at the first error.  
+ * \param filename The file to load
+ * \param result Set to the values in the file
+ * \param errors The error is added to this
+ * \return true if the file was loaded
+ */
+bool loadConfig(const std::string &filename, ConfigTable &result, std::vector<configError> &errors);
+
+/**
+ * \brief Loads a configuration file, reusing the unchanged files of a
+ * previous load
+ * \details Only files that changed are read and parsed again; the table is
+ * then rebuilt from the parsed files.  
+ * \param filename The file to load
+ * \param cache The files of the previous load, replaced by those of this one
+ * \param result Set to the values in the file
+ * \param errors The error is added to this
+ * \param lazy If values other than strings are left unparsed, with unparsed
+ * set and arrayVal pointing to an unparsedValue.  Errors in their syntax are
+ * then only found when they are parsed.  
+ * \param copy If the files are copied into memory rather than mapped, so that
+ * they may be edited in place while the configuration is in use
+ * \return true if the file was loaded
+ */
+bool loadConfig(const std::string &filename, parseCache &cache, ConfigTable &result,
+                std::vector<configError> &errors, bool lazy = false, bool copy = false);
+
+/**
+ * \brief Loads a configuration from a stream, parsing it as its chunks arrive
+ * \details Included configurations are opened with the resolver and parsed
+ * in the order they are found, each once.  
+ * \param name The name of the configuration, used in errors and passed to
+ * the resolver
+ * \param reader The chunks of the configuration
+ * \param resolver Opens the included configurations
+ * \param result Set to the values in the configuration
+ * \param errors The error is added to this
+ * \param lazy If values other than strings are left unparsed, as for loadConfig
+ * \return true if the configuration was loaded
+ */
+bool loadConfigStream(const std::string &name, const configChunkReader &reader,
+                      const configIncludeResolver &resolver, ConfigTable &result,
+                      std::vector<configError> &errors, bool lazy = false);
@@ -0,0 +1,83 @@
+/**
+ * \author Lucas Kramer
+ * \file  mapped_file.cpp
+ * \brief Implementation of memory-mapped file access.  
+ * \details See mapped_file.h for more information.  
+ */
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+#include "mapped_file.h"
+
+shared_ptr<const mappedFile> mappedFile::open(const string &filename) {
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  return open(fd);
+}
+
+shared_ptr<const mappedFile> mappedFile::open(int fd) {
+  struct stat st;
+  bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+  if (regular && st.st_size > 0) {
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      shared_ptr<mappedFile> result(new mappedFile());
+      madvise(addr, st.st_size, MADV_SEQUENTIAL);
+      result->data = (const char *)addr;
+      result->size = st.st_size;
+      result->mapped = true;
+      close(fd);
+      return result;
+    }
+  }
+
+  // Fall back to reading the whole file
+  return copy(fd, regular? st.st_size : 0);
+}
+
+shared_ptr<const mappedFile> mappedFile::read(const string &filename) {
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  size_t sizeHint = fstat(fd, &st) == 0 && S_ISREG(st.st_mode)? st.st_size : 0;
+  return copy(fd, sizeHint);
+}
+
+shared_ptr<const mappedFile> mappedFile::copy(int fd, size_t sizeHint) {
+  // The file may change size while it is read, so read until the end
+  unique_ptr<char[]> data(new char[sizeHint + 1]);
+  size_t capacity = sizeHint + 1, size = 0;
+  ssize_t n;
+  while ((n = ::read(fd, data.get() + size, capacity - size)) > 0) {
+    size += n;
+    if (size == capacity) {
+      capacity = capacity * 2 + 16384;
+      unique_ptr<char[]> larger(new char[capacity]);
+      copy_n(data.get(), size, larger.get());
+      data = move(larger);
+    }
+  }
+  close(fd);
+  if (n < 0)
+    return NULL;
+  shared_ptr<mappedFile> result(new mappedFile());
+  result->data = data.release();
+  result->size = size;
+  return result;
+}
+
+mappedFile::~mappedFile() {
+  if (mapped)
+    munmap((void *)data, size);
+  else
+    delete[] data;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  mapped_file.h
+ * \brief Read-only access to the contents of a configuration file.  
+ */
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * \brief The contents of a file, mapped into memory when possible.  
+ * \details Opened regular files are mmap'ed read-only, so processes loading the
+ * same file share its pages.  Other files (pipes, devices) and files that are
+ * read rather than opened are copied into a private buffer.  A mapping stays
+ * valid only as long as the file is replaced by renaming a new file over it
+ * rather than edited in place, since truncating a mapped file makes reading
+ * past its new end fault; a copy stays valid for the lifetime of the object.  
+ */
+class mappedFile {
+ public:
+  /**
+   * \brief Opens and maps a file
+   * \param filename The file to open
+   * \return The mapped file, or NULL if it could not be opened
+   */
+  static std::shared_ptr<const mappedFile> open(const std::string &filename);
+
+  /**
+   * \brief Maps an open file, such as a shared memory object
+   * \param fd The file descriptor, which is closed
+   * \return The mapped file, or NULL if it could not be read
+   */
+  static std::shared_ptr<const mappedFile> open(int fd);
+
+  /**
+   * \brief Copies the contents of a file into memory without mapping it
+   * \details Used for files that may be edited in place while their contents
+   * are still in use (see Configuration::setInPlaceEdits).  
+   * \param filename The file to read
+   * \return The file, or NULL if it could not be read
+   */
+  static std::shared_ptr<const mappedFile> read(const std::string &filename);
+
+  ~mappedFile();
+
+  mappedFile(const mappedFile &) = delete;
+  mappedFile &operator=(const mappedFile &) = delete;
+
+  /** \brief Gets the contents of the file */
+  std::string_view contents() const { return std::string_view(data, size); }
+
+ private:
+  mappedFile() : data(NULL), size(0), mapped(false) {}
+
+  /**
+   * \brief Reads the rest of an open file into a private buffer
+   * \param fd The file descriptor, which is closed
+   * \param sizeHint The expected size of the file
+   */
+  static std::shared_ptr<const mappedFile> copy(int fd, size_t sizeHint);
+
+  const char *data;
+  size_t size;
+  bool mapped;
+};
+
+/**
+ * \brief Iterates over the lines of a buffer, with the same splitting as getline.  
+ */
+class lineReader {
+ public:
+  explicit lineReader(std::string_view text) : rest(text) {}
+
+  /**
+   * \brief Gets the next line, without its trailing newline
+   * \param line Set to the line
+   * \return false if there are no more lines
+   */
+  bool next(std::string_view &line) {
+    if (rest.empty())
+      return false;
+    size_t end = rest.find('\n');
+    if (end == std::string_view::npos) {
+      line = rest;
+      rest = std::string_view();
+    }
+    else {
+      line = rest.substr(0, end);
+      rest.remove_prefix(end + 1);
+    }
+    return true;
+  }
+
+ private:
+  std::string_view rest;
+};
@@ -0,0 +1,73 @@
+/**
+ * \author Lucas Kramer
+ * \file  overrides.cpp
+ * \brief Implementation of the values set on the command line.  
+ * \details See overrides.h for more information.  
+ */
+
+#include <ctype.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+#include "overrides.h"
+#include "mapped_file.h"
+
+void configOverlay::addLayer(ConfigTable &&layer) {
+  layers.push_back(std::move(layer));
+}
+
+void configOverlay::applyTo(ConfigTable &dest) const {
+  size_t total = dest.values.size();
+  for (const ConfigTable &layer : layers)
+    total += layer.values.size();
+  dest.values.reserve(total);
+  for (auto layer = layers.rbegin(); layer != layers.rend(); layer++) {
+    for (const auto &value : layer->values)
+      dest.values.insert_or_assign(value.first, value.second);
+    dest.keepStorage(*layer);
+  }
+}
+
+argumentReader::argumentReader(shared_ptr<const mappedFile> file) :
+  file(file), text(file->contents()) {}
+
+bool argumentReader::next(string &arg) {
+  if (file == NULL) {
+    if (index >= argc)
+      return false;
+    arg = argv[index++];
+    return true;
+  }
+
+  // Skip whitespace and comments
+  while (pos < text.size()) {
+    if (isspace((unsigned char)text[pos]))
+      pos++;
+    else if (text[pos] == '#') {
+      while (pos < text.size() && text[pos] != '\n')
+        pos++;
+    }
+    else break;
+  }
+  if (pos == text.size())
+    return false;
+
+  arg.clear();
+  char quote = '\0';
+  for (; pos < text.size(); pos++) {
+    char c = text[pos];
+    if (quote == '\0' && isspace((unsigned char)c))
+      break;
+    else if (c == '\\' && quote != '\'' && pos + 1 < text.size())
+      arg += text[++pos];
+    else if (quote == '\0' && (c == '"' || c == '\''))
+      quote = c;
+    else if (c == quote)
+      quote = '\0';
+    else arg += c;
+  }
+  return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  overrides.h
+ * \brief Internal interface for the values set on the command line.  
+ * \details See Configuration::initConfig for the arguments.  
+ */
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "configuration.h"
+
+class mappedFile;
+
+/**
+ * \brief The values set on the command line, kept as layers in order of
+ * priority rather than merged as they are added.  
+ * \details The first layer holds the -D settings and takes precedence over
+ * the rest, which are the --add-config files in the order they were given.  
+ */
+class configOverlay {
+ public:
+  configOverlay() : layers(1) {}
+
+  /** \brief Gets the layer of -D settings */
+  ConfigTable &defines() { return layers[0]; }
+
+  /**
+   * \brief Adds a layer below the existing ones
+   * \param layer The values, such as those of an --add-config file
+   */
+  void addLayer(ConfigTable &&layer);
+
+  /**
+   * \brief Sets the values of every layer in a table, replacing its own
+   * \details The layers are applied from the lowest priority up, so every
+   * value is written once per layer that sets it and nothing is merged
+   * between layers.  
+   * \param dest The table to add the values to
+   */
+  void applyTo(ConfigTable &dest) const;
+
+ private:
+  std::vector<ConfigTable> layers;
+};
+
+/**
+ * \brief Reads command line arguments from argv or from an argument file.  
+ * \details An argument file holds arguments separated by whitespace.  Quotes
+ * group characters including whitespace into an argument, a \\ outside single
+ * quotes escapes the next character, and a # at the start of an argument
+ * begins a comment to the end of the line.  The file is mapped and read one
+ * argument at a time.  
+ */
+class argumentReader {
+ public:
+  argumentReader(int argc, char *argv[]) : argc(argc), argv(argv), index(1) {}
+
+  /**
+   * \param file The argument file
+   */
+  explicit argumentReader(std::shared_ptr<const mappedFile> file);
+
+  /**
+   * \brief Reads the next argument
+   * \param arg Set to the argument
+   * \return false if there are no more arguments
+   */
+  bool next(std::string &arg);
+
+ private:
+  int argc = 0;
+  char **argv = NULL;
+  int index = 0;
+
+  std::shared_ptr<const mappedFile> file;
+  std::string_view text;
+  size_t pos = 0;
+};
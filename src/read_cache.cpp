@@ -0,0 +1,39 @@
+/**
+ * \author Lucas Kramer
+ * \file  read_cache.cpp
+ * \brief Implementation of the per-thread cache of values read by name.  
+ * \details See read_cache.h for more information.  
+ */
+
+#include <mutex>
+#include <set>
+using namespace std;
+
+#include "read_cache.h"
+
+/** Guards the caches of the running threads, and the counts of exited ones.  */
+static mutex cacheMutex;
+static set<readCache *> liveCaches;
+static configCacheStats exitedCounts = {0, 0};
+
+readCache::readCache() : hits(0), misses(0) {
+  lock_guard<mutex> lock(cacheMutex);
+  liveCaches.insert(this);
+}
+
+readCache::~readCache() {
+  lock_guard<mutex> lock(cacheMutex);
+  liveCaches.erase(this);
+  exitedCounts.hits += hits.load(memory_order_relaxed);
+  exitedCounts.misses += misses.load(memory_order_relaxed);
+}
+
+configCacheStats readCache::totals() {
+  lock_guard<mutex> lock(cacheMutex);
+  configCacheStats result = exitedCounts;
+  for (readCache *cache : liveCaches) {
+    result.hits += cache->hits.load(memory_order_relaxed);
+    result.misses += cache->misses.load(memory_order_relaxed);
+  }
+  return result;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  read_cache.h
+ * \brief Internal interface for the per-thread cache of values read by name.  
+ * \details See Configuration::setReadCache for more information.  
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <string_view>
+
+#include "configuration.h"
+
+/**
+ * \brief A small direct-mapped cache of the values a thread recently read by
+ * name.  
+ * \details Each entry fills one cache line and holds a copy of the name, so a
+ * hit only touches memory owned by the thread.  Entries are tagged with the
+ * snapshot number of the configuration they were found in, so a refresh
+ * invalidates them all without touching them.  Names too long to copy are not
+ * cached.  
+ */
+class readCache {
+ public:
+  readCache();
+  ~readCache();
+
+  readCache(const readCache &) = delete;
+  readCache &operator=(const readCache &) = delete;
+
+  /**
+   * \brief Finds a value read before
+   * \param snapshot The snapshot number of the configuration
+   * \param name The name of the value
+   * \return The value, or NULL if it isn't cached
+   */
+  const configValue *find(unsigned long snapshot, std::string_view name) {
+    const entry &e = entries[index(name)];
+    if (e.snapshot == snapshot && e.length == name.size() && memcmp(e.name, name.data(), name.size()) == 0) {
+      count(hits);
+      return e.value;
+    }
+    count(misses);
+    return NULL;
+  }
+
+  /**
+   * \brief Adds a value, replacing the one with the same index
+   * \param snapshot The snapshot number of the configuration
+   * \param name The name of the value
+   * \param value The value, which lives as long as the configuration
+   */
+  void insert(unsigned long snapshot, std::string_view name, const configValue *value) {
+    if (name.size() > MAX_NAME)
+      return;
+    entry &e = entries[index(name)];
+    e.snapshot = snapshot;
+    e.value = value;
+    e.length = name.size();
+    memcpy(e.name, name.data(), name.size());
+  }
+
+  /**
+   * \brief Gets the counts of every thread, including those that exited
+   */
+  static configCacheStats totals();
+
+ private:
+  static const unsigned BITS = 6;
+  static const size_t MAX_NAME = 46;
+
+  struct alignas(64) entry {
+    /** 0 for an empty entry, which no configuration has.  */
+    unsigned long snapshot = 0;
+    const configValue *value = NULL;
+    unsigned char length = 0;
+    char name[MAX_NAME];
+  };
+  static_assert(sizeof(entry) == 64, "read cache entries should fill a cache line");
+
+  /** \brief Hashes the length and the first and last 8 bytes of a name */
+  static size_t index(std::string_view name) {
+    uint64_t h = name.size();
+    if (name.size() >= 8) {
+      uint64_t first, last;
+      memcpy(&first, name.data(), 8);
+      memcpy(&last, name.data() + name.size() - 8, 8);
+      h ^= first ^ (last >> 1);
+    }
+    else {
+      for (char c : name)
+        h = (h << 8) | (unsigned char)c;
+    }
+    return (h * 0x9E3779B97F4A7C15ull) >> (64 - BITS);
+  }
+
+  /** Only the owning thread writes the counts, read by totals from any thread.  */
+  static void count(std::atomic<unsigned long> &c) {
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  entry entries[1 << BITS];
+  std::atomic<unsigned long> hits;
+  std::atomic<unsigned long> misses;
+};
@@ -0,0 +1,248 @@
+/**
+ * \author Lucas Kramer
+ * \file  scanner.cpp
+ * \brief Implementation of the configuration file line tokenizer.  
+ * \details See scanner.h for more information.  
+ */
+
+#include <vector>
+#include <string_view>
+#include <ctype.h>
+using namespace std;
+
+#include "scanner.h"
+
+#ifdef CONFIG_BOOST_REGEX
+#include <boost/regex.hpp>
+#endif
+
+/**
+ * \brief Tests if the line only contains spaces and comments.  
+ */
+static bool isAllWhitespace(string_view line) {
+  for (size_t i = 0; i < line.length(); i++) {
+    if (line[i] == '#')
+      break;
+    else if (line[i] != ' ')
+      return false;
+  }
+  return true;
+}
+
+static string_view trimLeft(string_view text) {
+  while (!text.empty() && isspace((unsigned char)text[0]))
+    text.remove_prefix(1);
+  return text;
+}
+
+#ifdef CONFIG_BOOST_REGEX
+
+scannedLine scanLine(string_view line) {
+  static const boost::regex includeParse("use \"(.*)\"");
+  static const boost::regex lineParse("([A-Za-z][A-Za-z0-9_-]*) +([A-Za-z][A-Za-z0-9_-]*) *= *((?:[^\n# ]|\".*\")*) *(?:#.*)?");
+  static const boost::regex sectionParse("\\[((?:[A-Za-z][A-Za-z0-9_-]*(?:\\.[A-Za-z][A-Za-z0-9_-]*)*)?)\\] *(?:#.*)?");
+  static const boost::regex arrayParse("([A-Za-z][A-Za-z0-9_-]*\\[\\]) +([A-Za-z][A-Za-z0-9_-]*) *= *(\\[(?:[^\\]\"\n]|\"[^\"\n]*\")*\\]) *(?:#.*)?");
+
+  scannedLine result = {LINE_ERROR, {}, {}, {}};
+  if (isAllWhitespace(line)) {
+    result.kind = LINE_BLANK;
+    return result;
+  }
+
+  boost::cmatch parseResult; // parseResult[0] is the whole string
+  const char *begin = line.data(), *end = line.data() + line.size();
+  if (boost::regex_match(begin, end, parseResult, includeParse)) {
+    result.kind = LINE_INCLUDE;
+    result.value = string_view(parseResult[1].first, parseResult[1].length());
+  }
+  else if (boost::regex_match(begin, end, parseResult, sectionParse)) {
+    result.kind = LINE_SECTION;
+    result.name = string_view(parseResult[1].first, parseResult[1].length());
+  }
+  else if (boost::regex_match(begin, end, parseResult, lineParse) ||
+           boost::regex_match(begin, end, parseResult, arrayParse)) {
+    result.kind = LINE_SETTING;
+    result.type = string_view(parseResult[1].first, parseResult[1].length());
+    result.name = string_view(parseResult[2].first, parseResult[2].length());
+    result.value = trimLeft(string_view(parseResult[3].first, parseResult[3].length()));
+  }
+  return result;
+}
+
+#else
+
+static const size_t NO_MATCH = string_view::npos;
+
+static inline bool isPlain(char c) {
+  return c != '\n' && c != '#' && c != ' ';
+}
+
+/**
+ * \brief Returns the end of the identifier starting at pos, or pos if there is none.  
+ */
+static size_t scanIdent(string_view line, size_t pos) {
+  if (pos >= line.size() || !isIdentStart(line[pos]))
+    return pos;
+  for (pos++; pos < line.size() && isIdentChar(line[pos]); pos++);
+  return pos;
+}
+
+static size_t skipSpaces(string_view line, size_t pos) {
+  while (pos < line.size() && line[pos] == ' ')
+    pos++;
+  return pos;
+}
+
+/**
+ * \brief Tests if the rest of the line matches " *(#.*)?".  
+ */
+static bool isTail(string_view line, size_t pos) {
+  pos = skipSpaces(line, pos);
+  return pos == line.size() || line[pos] == '#';
+}
+
+/**
+ * \brief Finds the end of a value starting at begin, or NO_MATCH.  
+ * \details Gives the same result as a backtracking match of
+ * ((?:[^\n# ]|\".*\")*) followed by the tail: plain characters are preferred
+ * over quoted sections, and longer quoted sections over shorter ones.  The
+ * common case of a value that ends at the first space or # is handled without
+ * backtracking.  
+ */
+static size_t scanValue(string_view line, size_t begin) {
+  size_t end = begin;
+  while (end < line.size() && isPlain(line[end]))
+    end++;
+  if (isTail(line, end))
+    return end;
+
+  // Quoted sections may span spaces and #, which is only needed if some
+  // quote can be closed later in the line.  
+  size_t quotes = 0;
+  for (size_t i = begin; i < line.size() && quotes < 2; i++) {
+    if (line[i] == '"')
+      quotes++;
+  }
+  if (quotes < 2)
+    return NO_MATCH;
+
+  // valueEnd[p - begin] is the end of the first match of the rest of the value
+  // starting at p, computed from the right so each position is visited once.
+  // A quote at p is closed by the last later quote q after which the rest
+  // matches, which is the same for every p before q, so it is kept in closed
+  // rather than searched for at each quote.  
+  size_t n = line.size();
+  vector<size_t> valueEnd(n - begin + 1);
+  vector<bool> tail(n - begin + 1);
+  size_t closed = NO_MATCH;
+  for (size_t p = n + 1; p-- > begin;) {
+    tail[p - begin] = p == n || line[p] == '#' || (line[p] == ' ' && tail[p + 1 - begin]);
+    size_t r = NO_MATCH;
+    if (p < n && isPlain(line[p]))
+      r = valueEnd[p + 1 - begin];
+    if (r == NO_MATCH && p < n && line[p] == '"')
+      r = closed;
+    if (r == NO_MATCH && tail[p - begin])
+      r = p;
+    valueEnd[p - begin] = r;
+    if (closed == NO_MATCH && p < n && line[p] == '"')
+      closed = valueEnd[p + 1 - begin];
+  }
+  return valueEnd[0];
+}
+
+/**
+ * \brief Finds the end of an array value starting at begin, or NO_MATCH.  
+ * \details Matches \[(?:[^\]"\n]|"[^"\n]*")*\] followed by the tail: the
+ * array ends at the first ] that is not quoted.  
+ */
+static size_t scanArray(string_view line, size_t begin) {
+  if (begin >= line.size() || line[begin] != '[')
+    return NO_MATCH;
+  bool quoted = false;
+  for (size_t i = begin + 1; i < line.size(); i++) {
+    if (line[i] == '\n')
+      return NO_MATCH;
+    else if (line[i] == '"')
+      quoted = !quoted;
+    else if (line[i] == ']' && !quoted)
+      return isTail(line, i + 1)? i + 1 : NO_MATCH;
+  }
+  return NO_MATCH;
+}
+
+/**
+ * \brief Finds the end of a section header, or NO_MATCH.  
+ * \details Matches \[((?:ident(?:\.ident)*)?)\] followed by the tail.  
+ */
+static size_t scanSection(string_view line) {
+  size_t pos = 1;
+  if (pos < line.size() && line[pos] != ']') {
+    while (true) {
+      size_t end = scanIdent(line, pos);
+      if (end == pos)
+        return NO_MATCH;
+      pos = end;
+      if (pos >= line.size() || line[pos] != '.')
+        break;
+      pos++;
+    }
+  }
+  if (pos >= line.size() || line[pos] != ']' || !isTail(line, pos + 1))
+    return NO_MATCH;
+  return pos;
+}
+
+scannedLine scanLine(string_view line) {
+  scannedLine result = {LINE_ERROR, {}, {}, {}};
+  if (isAllWhitespace(line)) {
+    result.kind = LINE_BLANK;
+    return result;
+  }
+
+  // Check if the line is an include
+  if (line.size() >= 6 && line.compare(0, 5, "use \"") == 0 && line.back() == '"') {
+    result.kind = LINE_INCLUDE;
+    result.value = line.substr(5, line.size() - 6);
+    return result;
+  }
+
+  // Check if the line is a section header
+  if (line[0] == '[') {
+    size_t sectionEnd = scanSection(line);
+    if (sectionEnd != NO_MATCH) {
+      result.kind = LINE_SECTION;
+      result.name = line.substr(1, sectionEnd - 1);
+    }
+    return result;
+  }
+
+  // Parse line into type, name, and value.  
+  size_t typeEnd = scanIdent(line, 0);
+  if (typeEnd == 0)
+    return result;
+  bool array = line.compare(typeEnd, 2, "[]") == 0;
+  if (array)
+    typeEnd += 2;
+  size_t nameBegin = skipSpaces(line, typeEnd);
+  if (nameBegin == typeEnd)
+    return result;
+  size_t nameEnd = scanIdent(line, nameBegin);
+  if (nameEnd == nameBegin)
+    return result;
+  size_t equals = skipSpaces(line, nameEnd);
+  if (equals == line.size() || line[equals] != '=')
+    return result;
+  size_t valueBegin = skipSpaces(line, equals + 1);
+  size_t valueEnd = array? scanArray(line, valueBegin) : scanValue(line, valueBegin);
+  if (valueEnd == NO_MATCH)
+    return result;
+
+  result.kind = LINE_SETTING;
+  result.type = line.substr(0, typeEnd);
+  result.name = line.substr(nameBegin, nameEnd - nameBegin);
+  result.value = trimLeft(line.substr(valueBegin, valueEnd - valueBegin));
+  return result;
+}
+
+#endif
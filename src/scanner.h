@@ -0,0 +1,58 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  scanner.h
+ * \brief Tokenizer for single lines of a configuration file.  
+ * \details See configuration.h for a description of the format.  
+ */
+
+#include <string_view>
+
+/**
+ * \brief The kind of a scanned line.  
+ */
+enum lineKind {
+  LINE_BLANK,
+  LINE_INCLUDE,
+  LINE_SETTING,
+  LINE_SECTION,
+  LINE_ERROR
+};
+
+/**
+ * \brief The result of scanning a line.  
+ * \details All fields are views into the scanned line.  For LINE_INCLUDE only
+ * value is set, to the included filename, and for LINE_SECTION only name is
+ * set, to the section name (empty for a [] line).  
+ */
+struct scannedLine {
+  lineKind kind;
+  std::string_view type;
+  std::string_view name;
+  std::string_view value;
+};
+
+inline bool isIdentStart(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+inline bool isIdentChar(char c) {
+  return isIdentStart(c) || (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+/**
+ * \brief Splits a line into its type, name, and value text
+ * \details Accepts exactly the lines matched by the patterns
+ * use "(.*)" and
+ * ([A-Za-z][A-Za-z0-9_-]*) +([A-Za-z][A-Za-z0-9_-]*) *= *((?:[^\\n# ]|\".*\")*) *(?:#.*)?
+ * or, for array types,
+ * ([A-Za-z][A-Za-z0-9_-]*\[\]) +([A-Za-z][A-Za-z0-9_-]*) *= *(\[(?:[^\]\"\\n]|\"[^\"\\n]*\")*\]) *(?:#.*)?
+ * or, for section headers,
+ * \[((?:[A-Za-z][A-Za-z0-9_-]*(?:\.[A-Za-z][A-Za-z0-9_-]*)*)?)\] *(?:#.*)?
+ * and returns the same captures, in a single pass for lines without quoted
+ * values containing spaces or #.  
+ * \param line The line, without the trailing newline
+ * \return The scanned line
+ */
+scannedLine scanLine(std::string_view line);
@@ -0,0 +1,132 @@
+/**
+ * \author Lucas Kramer
+ * \file  shared.cpp
+ * \brief Implementation of shared memory configurations.  
+ * \details See shared.h for more information.  
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <memory>
+#include <string>
+using namespace std;
+
+#include "shared.h"
+#include "compiled.h"
+#include "mapped_file.h"
+
+static const char SHARED_MAGIC[8] = {'C', 'F', 'G', 'S', 'H', 'M', '\0', '\0'};
+
+/** \brief The contents of the control segment.  */
+struct sharedControl {
+  char magic[8];
+  /** The generation of the current data segment, or 0 before the first publish.  */
+  atomic<uint64_t> generation;
+};
+
+static_assert(atomic<uint64_t>::is_always_lock_free,
+              "the generation must be lock-free to be shared between processes");
+
+static string controlName(const string &name) {
+  return name.empty() || name[0] != '/'? "/" + name : name;
+}
+
+static string dataName(const string &name, uint64_t generation) {
+  return controlName(name) + "." + to_string(generation);
+}
+
+uint64_t publishSharedImage(const string &name, const string &image) {
+  int fd = shm_open(controlName(name).c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return 0;
+  void *addr = MAP_FAILED;
+  if (ftruncate(fd, sizeof(sharedControl)) == 0)
+    addr = mmap(NULL, sizeof(sharedControl), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return 0;
+  // A new segment is zero-filled, which is a valid generation of 0
+  sharedControl *control = (sharedControl *)addr;
+  if (memcmp(control->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) != 0) {
+    control->generation.store(0, memory_order_relaxed);
+    memcpy(control->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+  }
+
+  // Write the data segment in full before publishing it
+  uint64_t previous = control->generation.load(memory_order_relaxed);
+  uint64_t next = previous + 1;
+  string data = dataName(name, next);
+  // Left over from a publisher that stopped before publishing it
+  shm_unlink(data.c_str());
+  fd = shm_open(data.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  bool ok = fd >= 0 && !image.empty() && ftruncate(fd, image.size()) == 0;
+  if (ok) {
+    void *dataAddr = mmap(NULL, image.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ok = dataAddr != MAP_FAILED;
+    if (ok) {
+      memcpy(dataAddr, image.data(), image.size());
+      munmap(dataAddr, image.size());
+    }
+  }
+  if (fd >= 0)
+    close(fd);
+  if (!ok) {
+    shm_unlink(data.c_str());
+    munmap(addr, sizeof(sharedControl));
+    return 0;
+  }
+
+  control->generation.store(next, memory_order_release);
+  munmap(addr, sizeof(sharedControl));
+  if (previous != 0)
+    shm_unlink(dataName(name, previous).c_str());
+  return next;
+}
+
+unique_ptr<sharedSegment> sharedSegment::attach(const string &name) {
+  int fd = shm_open(controlName(name).c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return NULL;
+  void *addr = mmap(NULL, sizeof(sharedControl), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return NULL;
+  const sharedControl *control = (const sharedControl *)addr;
+  if (memcmp(control->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) != 0) {
+    munmap(addr, sizeof(sharedControl));
+    return NULL;
+  }
+  return unique_ptr<sharedSegment>(new sharedSegment(name, control));
+}
+
+sharedSegment::~sharedSegment() {
+  munmap((void *)control, sizeof(sharedControl));
+}
+
+uint64_t sharedSegment::generation() const {
+  return control->generation.load(memory_order_acquire);
+}
+
+bool sharedSegment::load(unique_ptr<const compiledImage> &image, uint64_t &loaded) const {
+  // The data segment is unlinked once the next one is published, so if it is
+  // gone, a newer generation is available
+  uint64_t current = generation();
+  while (current != 0) {
+    int fd = shm_open(dataName(name, current).c_str(), O_RDONLY, 0);
+    if (fd >= 0) {
+      shared_ptr<const mappedFile> input = mappedFile::open(fd);
+      if (input == NULL || (image = compiledImage::open(input)) == NULL)
+        return false;
+      loaded = current;
+      return true;
+    }
+    uint64_t next = generation();
+    if (next == current)
+      return false;
+    current = next;
+  }
+  return false;
+}
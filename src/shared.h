@@ -0,0 +1,70 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  shared.h
+ * \brief Publishes compiled configurations through POSIX shared memory.  
+ * \details A configuration named /NAME is published as a control segment
+ * /NAME, holding the current generation, and a data segment /NAME.\<generation\>
+ * for each published configuration, holding its compiled form (see
+ * compiled.h).  The compiled form only uses offsets, so it can be mapped at
+ * any address, and its values are looked up in place through the perfect hash
+ * stored with them, so every attached process shares one table.  A new
+ * configuration is published by writing
+ * a new data segment and then storing its generation in the control segment,
+ * after which the previous data segment is unlinked; processes that have
+ * mapped it keep it until they move on.  
+ */
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include "configuration.h"
+
+class compiledImage;
+struct sharedControl;
+
+/**
+ * \brief Publishes the compiled form of a configuration
+ * \details Only one process should publish to a name at a time.  
+ * \param name The name of the configuration, with or without a leading /
+ * \param image The compiled form, from compileValues
+ * \return The generation published, or 0 if it could not be published
+ */
+uint64_t publishSharedImage(const std::string &name, const std::string &image);
+
+/**
+ * \brief The control segment of a published configuration, mapped read-only.  
+ */
+class sharedSegment {
+ public:
+  /**
+   * \brief Maps the control segment of a configuration
+   * \param name The name of the configuration, with or without a leading /
+   * \return The segment, or NULL if nothing has been published to the name
+   */
+  static std::unique_ptr<sharedSegment> attach(const std::string &name);
+
+  ~sharedSegment();
+
+  sharedSegment(const sharedSegment &) = delete;
+  sharedSegment &operator=(const sharedSegment &) = delete;
+
+  /** \brief Gets the generation of the current configuration */
+  uint64_t generation() const;
+
+  /**
+   * \brief Maps the current configuration
+   * \param image Set to the mapped data segment, which values are read from
+   * \param loaded Set to the generation that was mapped
+   * \return false if the configuration could not be mapped
+   */
+  bool load(std::unique_ptr<const compiledImage> &image, uint64_t &loaded) const;
+
+ private:
+  sharedSegment(const std::string &name, const sharedControl *control) : name(name), control(control) {}
+
+  std::string name;
+  const sharedControl *control;
+};
@@ -0,0 +1,227 @@
+/**
+ * \author Lucas Kramer
+ * \file  stats.cpp
+ * \brief Implementation of the statistics collected with CONFIG_STATS.  
+ * \details See Configuration::dumpStats for more information.  Each thread
+ * keeps its own list of counters, which only it writes.  New counters are
+ * pushed onto the front of the list, so dumpStats can walk a list while its
+ * thread keeps adding to it.  When a thread exits, its counts are folded into
+ * a shared total.  
+ */
+
+#ifdef CONFIG_STATS
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include "configuration.h"
+#include "stats.h"
+
+/**
+ * \brief The counters of a thread.  
+ */
+struct threadCounters {
+  threadCounters();
+  ~threadCounters();
+
+  /** Only used by the owning thread.  */
+  unordered_map<string, configCounter *> index;
+  vector<configCounter *> slots;
+
+  /** The most recently added counter.  */
+  atomic<configCounter *> head;
+};
+
+/**
+ * \brief The time spent parsing a file.  
+ */
+struct fileStats {
+  size_t bytes = 0;
+  unsigned long parses = 0;
+  unsigned long reuses = 0;
+  double parseMs = 0;
+  double lastParseMs = 0;
+};
+
+/** The total counts of a value, by name and site.  */
+typedef map<pair<string, string>, pair<unsigned long, unsigned long>> countTable;
+
+// Guards everything below
+static mutex statsMutex;
+static set<threadCounters *> liveThreads;
+static countTable exitedThreads;
+static map<string, fileStats> files;
+static unsigned long loads = 0;
+static double loadMs = 0;
+static double lastLoadMs = 0;
+
+static thread_local threadCounters localCounters;
+
+threadCounters::threadCounters() : head(NULL) {
+  lock_guard<mutex> lock(statsMutex);
+  liveThreads.insert(this);
+}
+
+threadCounters::~threadCounters() {
+  lock_guard<mutex> lock(statsMutex);
+  liveThreads.erase(this);
+  for (configCounter *c = head.load(); c != NULL; ) {
+    pair<unsigned long, unsigned long> &total = exitedThreads[make_pair(c->name, c->site? c->site : "")];
+    total.first += c->reads.load(memory_order_relaxed);
+    total.second += c->misses.load(memory_order_relaxed);
+    configCounter *next = c->next;
+    delete c;
+    c = next;
+  }
+}
+
+static configCounter *newCounter(string_view name, const char *site) {
+  configCounter *c = new configCounter;
+  c->name = string(name);
+  c->site = site;
+  c->reads.store(0, memory_order_relaxed);
+  c->misses.store(0, memory_order_relaxed);
+  c->next = localCounters.head.load(memory_order_relaxed);
+  // Publish the initialized counter to dumpStats
+  localCounters.head.store(c, memory_order_release);
+  return c;
+}
+
+configCounter *Configuration::statsCounter(string_view name, const char *site) {
+  string key(name);
+  if (site != NULL) {
+    key += '\0';
+    key += site;
+  }
+  configCounter *&c = localCounters.index[key];
+  if (c == NULL)
+    c = newCounter(name, site);
+  return c;
+}
+
+configCounter *Configuration::slotCounter(unsigned slot, const char *name) {
+  vector<configCounter *> &slots = localCounters.slots;
+  if (slot >= slots.size())
+    slots.resize(slot + 1, NULL);
+  if (slots[slot] == NULL)
+    slots[slot] = newCounter(name, "CONFIG_KEY");
+  return slots[slot];
+}
+
+void recordParse(const string &filename, size_t bytes, double ms, bool reused) {
+  lock_guard<mutex> lock(statsMutex);
+  fileStats &stats = files[filename];
+  if (reused)
+    stats.reuses++;
+  else {
+    stats.bytes = bytes;
+    stats.parses++;
+    stats.parseMs += ms;
+    stats.lastParseMs = ms;
+  }
+}
+
+void recordLoad(double ms) {
+  lock_guard<mutex> lock(statsMutex);
+  loads++;
+  loadMs += ms;
+  lastLoadMs = ms;
+}
+
+void Configuration::dumpStats(ostream &out) {
+  lock_guard<mutex> lock(statsMutex);
+  countTable totals = exitedThreads;
+  for (threadCounters *t : liveThreads) {
+    for (configCounter *c = t->head.load(memory_order_acquire); c != NULL; c = c->next) {
+      pair<unsigned long, unsigned long> &total = totals[make_pair(c->name, c->site? c->site : "")];
+      total.first += c->reads.load(memory_order_relaxed);
+      total.second += c->misses.load(memory_order_relaxed);
+    }
+  }
+
+  out << "Configuration loads: " << loads << ", " << loadMs << " ms total, " <<
+    lastLoadMs << " ms last" << endl;
+  configCacheStats cache = Configuration::readCacheStats();
+  if (cache.hits + cache.misses != 0)
+    out << "Read cache: " << cache.hits << " hits, " << cache.misses << " misses" << endl;
+  for (auto it = files.begin(); it != files.end(); it++) {
+    out << "File " << it->first << ": " << it->second.bytes << " bytes, parsed " <<
+      it->second.parses << " times in " << it->second.parseMs << " ms total, " <<
+      it->second.lastParseMs << " ms last, reused " << it->second.reuses << " times" << endl;
+  }
+
+  // Most read first
+  vector<countTable::const_iterator> order;
+  for (auto it = totals.begin(); it != totals.end(); it++)
+    order.push_back(it);
+  stable_sort(order.begin(), order.end(), [](countTable::const_iterator a, countTable::const_iterator b) {
+    return a->second.first > b->second.first;
+  });
+  for (countTable::const_iterator it : order) {
+    if (it->first.second.empty()) {
+      out << "Variable " << it->first.first << ": " << it->second.first << " lookups, " <<
+        it->second.second << " misses" << endl;
+    }
+    else {
+      out << "Variable " << it->first.first << " at " << it->first.second << ": " <<
+        it->second.first << " reads" << endl;
+    }
+  }
+}
+
+/**
+ * \brief Calls dumpStats periodically until destroyed.  
+ */
+class statsLogger {
+ public:
+  statsLogger(unsigned intervalMs, ostream &out) : stopping(false) {
+    thread = std::thread([this, intervalMs, &out] {
+      unique_lock<std::mutex> lock(mutex);
+      while (!stopped.wait_for(lock, chrono::milliseconds(intervalMs), [this] { return stopping; })) {
+        lock.unlock();
+        Configuration::dumpStats(out);
+        lock.lock();
+      }
+    });
+  }
+
+  ~statsLogger() {
+    {
+      lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    stopped.notify_all();
+    thread.join();
+  }
+
+ private:
+  std::mutex mutex;
+  condition_variable stopped;
+  bool stopping;
+  std::thread thread;
+};
+
+// Declared after the statistics, so that logging stops before they are destroyed
+static mutex loggerMutex;
+static unique_ptr<statsLogger> logger;
+
+void Configuration::logStats(unsigned intervalMs, ostream &out) {
+  lock_guard<mutex> lock(loggerMutex);
+  logger.reset();
+  if (intervalMs > 0)
+    logger.reset(new statsLogger(intervalMs, out));
+}
+
+#endif
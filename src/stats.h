@@ -0,0 +1,31 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  stats.h
+ * \brief Internal interface for recording load timings when built with
+ * CONFIG_STATS.  
+ * \details See Configuration::dumpStats for more information.  
+ */
+
+#ifdef CONFIG_STATS
+
+#include <stddef.h>
+#include <string>
+
+/**
+ * \brief Records the parsing of a file
+ * \param filename The file
+ * \param bytes The size of the file
+ * \param ms The time spent reading and parsing it
+ * \param reused If the parse of a previous load was reused instead
+ */
+void recordParse(const std::string &filename, size_t bytes, double ms, bool reused);
+
+/**
+ * \brief Records a load of the configuration
+ * \param ms The time spent loading it
+ */
+void recordLoad(double ms);
+
+#endif
@@ -0,0 +1,49 @@
+/**
+ * \author Lucas Kramer
+ * \file  thread_pool.cpp
+ * \brief Implementation of the worker thread pool.  
+ * \details See thread_pool.h for more information.  
+ */
+
+#include <utility>
+using namespace std;
+
+#include "thread_pool.h"
+
+threadPool::threadPool(unsigned threads) : stopping(false) {
+  for (unsigned i = 0; i < (threads > 0? threads : 1); i++)
+    workers.emplace_back(&threadPool::run, this);
+}
+
+threadPool::~threadPool() {
+  {
+    lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  available.notify_all();
+  for (size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+}
+
+void threadPool::submit(function<void()> task) {
+  {
+    lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+  }
+  available.notify_one();
+}
+
+void threadPool::run() {
+  while (true) {
+    function<void()> task;
+    {
+      unique_lock<std::mutex> lock(mutex);
+      available.wait(lock, [this] { return stopping || !tasks.empty(); });
+      if (tasks.empty())
+        return;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
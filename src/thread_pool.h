@@ -0,0 +1,46 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  thread_pool.h
+ * \brief A small fixed-size pool of worker threads.  
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Runs submitted tasks on a fixed number of threads.  
+ * \details Tasks are run in submission order.  The destructor waits for all
+ * submitted tasks to finish.  
+ */
+class threadPool {
+ public:
+  /**
+   * \param threads The number of worker threads, at least 1
+   */
+  explicit threadPool(unsigned threads);
+  ~threadPool();
+
+  threadPool(const threadPool &) = delete;
+  threadPool &operator=(const threadPool &) = delete;
+
+  /**
+   * \brief Queues a task to run on a worker thread
+   * \param task The task
+   */
+  void submit(std::function<void()> task);
+
+ private:
+  void run();
+
+  std::mutex mutex;
+  std::condition_variable available;
+  std::deque<std::function<void()>> tasks;
+  bool stopping;
+  std::vector<std::thread> workers;
+};
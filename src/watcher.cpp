@@ -0,0 +1,154 @@
+/**
+ * \author Lucas Kramer
+ * \file  watcher.cpp
+ * \brief Implementation of the configuration file watcher.  
+ * \details See watcher.h for more information.  
+ */
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <utility>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+using namespace std;
+
+#include "watcher.h"
+
+fileWatcher::fileWatcher(function<void()> onChange, function<vector<string>()> files,
+                         unsigned delayMs, bool poll) :
+  onChange(std::move(onChange)), files(std::move(files)), delayMs(delayMs), poll(poll) {
+  // Without a way to wake it up, the thread could not be stopped
+  if (pipe(stopPipe) == 0)
+    thread = std::thread(&fileWatcher::run, this);
+}
+
+fileWatcher::~fileWatcher() {
+  if (!thread.joinable())
+    return;
+  char c = 0;
+  while (write(stopPipe[1], &c, 1) != 1) {}
+  thread.join();
+  close(stopPipe[0]);
+  close(stopPipe[1]);
+}
+
+void fileWatcher::run() {
+  if (poll || !watchFiles())
+    pollFiles();
+}
+
+/**
+ * \brief Splits a path into the directory containing it and its name
+ */
+static pair<string, string> splitPath(const string &filename) {
+  size_t slash = filename.rfind('/');
+  if (slash == string::npos)
+    return make_pair(string("."), filename);
+  return make_pair(slash == 0? string("/") : filename.substr(0, slash), filename.substr(slash + 1));
+}
+
+bool fileWatcher::watchFiles() {
+#ifdef __linux__
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  const uint32_t mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+    IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+  // The watched directories, and the names of the files in each
+  map<string, int> directories;
+  map<int, set<string>> names;
+
+  auto update = [&] {
+    map<string, int> previous = std::move(directories);
+    directories.clear();
+    names.clear();
+    for (const string &filename : files()) {
+      pair<string, string> path = splitPath(filename);
+      auto it = directories.find(path.first);
+      if (it == directories.end()) {
+        auto old = previous.find(path.first);
+        int wd;
+        if (old != previous.end()) {
+          wd = old->second;
+          previous.erase(old);
+        }
+        else wd = inotify_add_watch(fd, path.first.c_str(), mask);
+        if (wd < 0)
+          continue;
+        it = directories.emplace(path.first, wd).first;
+      }
+      names[it->second].insert(path.second);
+    }
+    for (auto it = previous.begin(); it != previous.end(); it++)
+      inotify_rm_watch(fd, it->second);
+  };
+  update();
+
+  bool pending = false;
+  chrono::steady_clock::time_point deadline;
+  alignas(struct inotify_event) char buffer[4096];
+  while (true) {
+    int timeout = -1;
+    if (pending) {
+      auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+      timeout = remaining.count() > 0? (int)remaining.count() : 0;
+    }
+
+    struct pollfd fds[2] = {{stopPipe[0], POLLIN, 0}, {fd, POLLIN, 0}};
+    int ready = ::poll(fds, 2, timeout);
+    if (ready < 0)
+      continue;
+    if (fds[0].revents)
+      break;
+
+    if (ready == 0) {
+      // No change for the delay, so the burst is over
+      pending = false;
+      onChange();
+      update();
+      continue;
+    }
+
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+      for (char *p = buffer; p < buffer + length; ) {
+        struct inotify_event *event = (struct inotify_event *)p;
+        p += sizeof(struct inotify_event) + event->len;
+
+        bool relevant;
+        if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF))
+          relevant = true;
+        else {
+          auto it = names.find(event->wd);
+          relevant = event->len > 0 && it != names.end() && it->second.count(event->name);
+        }
+        if (relevant) {
+          pending = true;
+          deadline = chrono::steady_clock::now() + chrono::milliseconds(delayMs);
+        }
+      }
+    }
+  }
+  close(fd);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void fileWatcher::pollFiles() {
+  while (true) {
+    struct pollfd fds[1] = {{stopPipe[0], POLLIN, 0}};
+    int ready = ::poll(fds, 1, (int)delayMs);
+    if (ready > 0)
+      break;
+    if (ready == 0)
+      onChange();
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+/**
+ * \author Lucas Kramer
+ * \file  watcher.h
+ * \brief Watches configuration files for changes on a background thread.  
+ */
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Calls a function on a background thread when any of a set of files
+ * changes.  
+ * \details On Linux the directories containing the files are watched with
+ * inotify, so that files replaced by renaming a new file over them are seen.  
+ * Bursts of changes are coalesced: the function is called once no further
+ * change has been seen for the delay.  Elsewhere, or if inotify is not
+ * available, the function is called every delay instead, and is expected to
+ * check for changes itself.  
+ */
+class fileWatcher {
+ public:
+  /**
+   * \param onChange Called after the files change
+   * \param files Gets the files to watch, called again after every change
+   * \param delayMs The debounce delay, or the polling interval
+   * \param poll If the function is called every delay even where inotify is
+   * available
+   */
+  fileWatcher(std::function<void()> onChange,
+              std::function<std::vector<std::string>()> files,
+              unsigned delayMs, bool poll = false);
+
+  /** \brief Stops watching, waiting for a running call to finish */
+  ~fileWatcher();
+
+  fileWatcher(const fileWatcher &) = delete;
+  fileWatcher &operator=(const fileWatcher &) = delete;
+
+ private:
+  void run();
+  bool watchFiles();
+  void pollFiles();
+
+  std::function<void()> onChange;
+  std::function<std::vector<std::string>()> files;
+  unsigned delayMs;
+  bool poll;
+
+  /** Written to by the destructor to wake up the thread.  */
+  int stopPipe[2];
+
+  std::thread thread;
+};
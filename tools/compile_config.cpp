@@ -0,0 +1,26 @@
+/**
+ * \author Lucas Kramer
+ * \file  compile_config.cpp
+ * \brief Command line tool to compile a configuration file.  
+ * \details Usage: compile_config \<file\> [\<output\>]<br>
+ * The output defaults to the file with .bin appended, which is where
+ * Configuration looks for it.  
+ */
+
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "configuration.h"
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    cerr << "Usage: " << argv[0] << " <file> [<output>]" << endl;
+    return 1;
+  }
+  if (!Configuration::compileConfig(argv[1], argc == 3? argv[2] : "")) {
+    cerr << "Could not write compiled configuration for " << argv[1] << endl;
+    return 1;
+  }
+  return 0;
+}
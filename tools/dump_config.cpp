@@ -0,0 +1,48 @@
+/**
+ * \author Lucas Kramer
+ * \file  dump_config.cpp
+ * \brief Command line tool to print the values of a configuration.  
+ * \details Usage: dump_config [--binary] \<file\> [\<arguments\>...]<br>
+ * The configuration is loaded as initConfig would with the arguments, such as
+ * -D and --add-config, and every value is written to standard output in order
+ * of name, as a configuration file or with --binary in compiled form.  
+ */
+
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "configuration.h"
+
+int main(int argc, char *argv[]) {
+  int first = 1;
+  configDumpFormat format = CONFIG_DUMP_TEXT;
+  if (first < argc && strcmp(argv[first], "--binary") == 0) {
+    format = CONFIG_DUMP_BINARY;
+    first++;
+  }
+  if (first >= argc) {
+    cerr << "Usage: " << argv[0] << " [--binary] <file> [<arguments>...]" << endl;
+    return 1;
+  }
+
+  // The arguments after the file are passed on as a command line
+  string filename = argv[first];
+  vector<char *> args = {argv[0]};
+  args.insert(args.end(), argv + first + 1, argv + argc);
+  vector<configError> errors = Configuration::tryInitConfig(args.size(), args.data(), filename);
+  if (errors.empty())
+    errors = Configuration::tryRefresh();
+  for (const configError &error : errors)
+    cerr << error.message() << endl;
+  if (!errors.empty())
+    return 1;
+
+  if (!Configuration::get()->dumpConfig(cout, format)) {
+    cerr << "Could not write every value of " << filename << endl;
+    return 1;
+  }
+  return 0;
+}